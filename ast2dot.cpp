@@ -1,76 +1,248 @@
 #include "ast.hpp"
 #include "symtab.hpp"
 #include "primitive.hpp"
+#include "dotwriter.hpp"
+#include "ast2dot.hpp"
+#include "eventtrace.hpp"
+#include "visitprofile.hpp"
+#include "stats.hpp"
+#include "passmanager.hpp"
 
-#include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <map>
 #include <stack>
+#include <thread>
+#include <vector>
 
 class Ast2dot : public Visitor
 {
     private:
-    FILE *m_out;        // File for writting output
+    DotWriter* m_out;   // Writer for the output, NULL to only count nodes
     int count;          // Used to give each node a uniq id
     std::stack<int> s;  // Stack for tracking parent/child pairs
 
+    const DotLimits* m_limits;  // What to leave out, NULL to draw everything
+    int m_first;                // Number before our first node
+    int m_depth;                // Depth of the nodes hanging off the parent
+    std::map<const char*, int>* m_kinds;    // Tally of node kinds, or NULL
+    size_t m_marked;            // Shallowest parent (as s.size()) marked as
+                                // having nodes left out by max_nodes
+
+    // Depth of the next node drawn
+    int depth() { return m_depth + (int)s.size() - 1; }
+
+    // Give the next node a number and link it to its parent
+    void enter(const char* n)
+    {
+       count++;                         // Each node gets a unique number
+       add_edge(s.top(), count);        // From parent to this
+       if(m_kinds) {
+           (*m_kinds)[n]++;
+       }
+    }
+
+    // True if the children of a node at depth d should be summarized
+    bool cut_below(int d)
+    {
+        return m_limits != NULL && m_limits->max_depth >= 0
+            && d >= m_limits->max_depth;
+    }
+
+    // Draw all of p's children as one node with their count and top kinds.
+    // This walks the subtree, so the cuts cost a visit of every node below
+    // them.
+    void summarize(Visitable* p)
+    {
+        std::map<const char*, int> kinds;
+        Ast2dot counter(NULL);
+        counter.m_kinds = &kinds;
+        p->visit_children(&counter);
+        if(counter.last() == 0) {
+            return;
+        }
+
+        count++;
+        add_edge(s.top(), count);
+        if(m_out == NULL) {
+            return;
+        }
+        std::vector<std::pair<int, const char*> > top;
+        for(std::map<const char*, int>::iterator i = kinds.begin();
+                i != kinds.end(); ++i) {
+            top.push_back(std::make_pair(-i->second, i->first));
+        }
+        // Most common first, ties broken by name so output is stable
+        std::sort(top.begin(), top.end(),
+                  [](const std::pair<int, const char*>& a,
+                     const std::pair<int, const char*>& b) {
+            return a.first != b.first ? a.first < b.first
+                                      : strcmp(a.second, b.second) < 0;
+        });
+
+        std::string label = std::to_string(counter.last()) + " more nodes";
+        for(size_t i = 0; i < top.size() && i < 3; i++) {
+            label += "\\n";
+            label += top[i].second;
+            label += " x" + std::to_string(-top[i].first);
+        }
+        m_out->node(count, label.c_str());
+    }
+
+    // True if p is a top level procedure that m_limits leaves out
+    bool skip_proc(ProcImpl* p)
+    {
+        return m_limits != NULL && !m_limits->procs.empty() && depth() == 1
+            && m_limits->procs.count(p->m_symname->spelling()) == 0;
+    }
+
     public:
 
-    Ast2dot(FILE* out)
+    // Nodes are numbered from first+1 and top level nodes hang off parent
+    // at the given depth, so a subtree can be drawn on its own and spliced
+    // into a whole graph
+    Ast2dot(DotWriter* out, const DotLimits* limits = NULL,
+            int parent = 0, int first = 0, int depth = 0)
     {
-       count = 0;
-       s.push(0);
+       count = first;
+       s.push(parent);
        m_out = out;
-       std::fprintf(m_out, "digraph G { page=\"8.5,11\"; size=\"7.5, 10\"; \n");
+       m_limits = limits;
+       m_first = first;
+       m_depth = depth;
+       m_kinds = NULL;
+       m_marked = (size_t)-1;
+    }
+
+    // Number of the last node drawn
+    int last() { return count; }
+
+    void start()
+    {
+        m_out->put("digraph G { page=\"8.5,11\"; size=\"7.5, 10\"; \n");
     }
 
     void finish()
     {
-        std::fprintf(m_out, "}\n");
+        m_out->put("}\n");
+        m_out->flush();
     }
 
     void add_edge(int p, int c)
     {
-        std::fprintf(m_out, "\"%d\" -> \"%d\"\n", p, c);
+        if(m_out) {
+            m_out->edge(p, c);
+        }
     }
 
     void add_node(int c, const char* n)
     {
-        std::fprintf(m_out, "\"%d\" [label=\"%s\"]\n" , c, n);
+        if(m_out) {
+            m_out->node(c, n);
+        }
     }
 
-    void draw(const char* n, Visitable* p)
+    // False once max_nodes nodes are drawn, and the node about to be drawn
+    // is to be left out (see DotLimits)
+    bool admit()
     {
-       count++;                         // Each node gets a unique number
-       add_edge(s.top(), count);        // From parent to this
+        if(m_limits == NULL || m_limits->max_nodes < 0
+                || count - m_first < m_limits->max_nodes) {
+            return true;
+        }
+        if(s.size() < m_marked) {
+            m_marked = s.size();
+            count++;
+            add_edge(s.top(), count);
+            add_node(count, "more nodes");
+        }
+        return false;
+    }
+
+    // The first half of draw, for Ast2dotPass: true if the children are
+    // to be summarized rather than visited.  The node must be admitted.
+    bool open(const char* n)
+    {
+       int d = depth();
+       enter(n);
        add_node(count, n);              // Name the this node
        s.push(count);                   // This node is the parent
-       p->visit_children(this);
+       return cut_below(d);
+    }
+
+    // and the second, once the children have been visited unless cut
+    void close(Visitable* p, bool cut)
+    {
+       if(cut) {
+           summarize(p);                // Stop descending here
+       }
        s.pop();                         // Restore old parent
     }
 
+    void draw(const char* n, Visitable* p)
+    {
+       if(!admit()) {
+           return;
+       }
+       bool cut = open(n);
+       if(!cut) {
+           p->visit_children(this);
+       }
+       close(p, cut);
+    }
+
     void draw_symname(const char* n, SymName* p)
     {
-       count++;                         // Each node gets a unique number
-       add_edge(s.top(), count);        // From parent to this
+       if(!admit()) {
+           return;
+       }
+       enter(n);
        // Print symname strings
-       std::fprintf(m_out, "\"%d\" [label=\"%s\\n\\\"%s\\\"\"]\n" , count, n, p->spelling());
+       if(m_out) {
+           m_out->node_string(count, n, p->spelling());
+       }
     }
 
     void draw_primitive(const char* n, Primitive* p)
     {
-       count++;                         // Each node gets a unique number
-       add_edge(s.top(), count);        // From parent to this
-       std::fprintf(m_out, "\"%d\" [label=\"%s\\n%d\"]\n" , count, n, p->m_data);
+       if(!admit()) {
+           return;
+       }
+       enter(n);
+       if(m_out) {
+           m_out->node_int(count, n, p->m_data);
+       }
     }
 
     void draw_string_primitive(const char* n, StringPrimitive* p)
     {
-       count++;                         // Each node gets a unique number
-       add_edge(s.top(), count);        // From parent to this
-       std::fprintf(m_out, "\"%d\" [label=\"%s\\n\\\"%s\\\"\"]\n" , count, n, p->m_string);
+       if(!admit()) {
+           return;
+       }
+       enter(n);
+       if(m_out) {
+           m_out->node_string(count, n, p->m_string);
+       }
     }
 
     void visitProgramImpl(ProgramImpl *p) { draw("ProgramImpl", p); }
-    void visitProcImpl(ProcImpl *p) { draw("ProcImpl", p); }
+    void visitProcImpl(ProcImpl *p)
+    {
+        if(skip_proc(p)) {
+            return;
+        }
+        if(event_trace == NULL || m_out == NULL) {
+            draw("ProcImpl", p);
+            return;
+        }
+        double start = event_trace->now();
+        int before = count;
+        draw("ProcImpl", p);
+        event_trace->span("ast2dot", p->m_symname->spelling(), start,
+                          count - before);
+    }
     void visitProcedure_blockImpl(Procedure_blockImpl *p) { draw("ProcedureBlockImpl", p); }
     void visitNested_blockImpl(Nested_blockImpl *p) { draw("NestedBlockImpl", p); }
     void visitDeclImpl(DeclImpl *p) { draw("DeclImpl", p); }
@@ -126,10 +298,150 @@ class Ast2dot : public Visitor
     void visitStringPrimitive(StringPrimitive *p) { draw_string_primitive("StringPrimitive",p); }
 };
 
-void dopass_ast2dot(Program_ptr ast)
+void dopass_ast2dot(Program_ptr ast, int fd, const DotLimits* limits,
+                    VisitProfile* profile)
 {
-    Ast2dot* ast2dot = new Ast2dot(stdout);     // Create new visitor
+    DotWriter out(fd);
+    Ast2dot* ast2dot;                               // Create new visitor
+    if(profile) {
+        ast2dot = new VisitProfiled<Ast2dot>(profile, &out, limits);
+    } else {
+        ast2dot = new Ast2dot(&out, limits);
+    }
+    ast2dot->start();
     ast->accept(ast2dot);                       // Walk the tree with the visitor above
     ast2dot->finish();                          // Finalize printout
     delete ast2dot;
 }
+
+// Ast2dot as one of the passes of a PassManager
+class Ast2dotPass : public FusedPass
+{
+  private:
+    Ast2dot m_draw;
+    bool m_drawn;       // The program node is drawn
+    bool m_cut;         // Everything below the program is summarized
+
+  public:
+    Ast2dotPass(DotWriter* out, const DotLimits* limits)
+        : m_draw(out, limits) { m_drawn = false; m_cut = false; }
+
+    int order() { return pre_order | post_order; }
+
+    void program(ProgramImpl* p, Order when)
+    {
+        if(when == pre_order) {
+            m_draw.start();
+            m_drawn = m_draw.admit();
+            if(m_drawn) {
+                m_cut = m_draw.open("ProgramImpl");
+            }
+        } else {
+            if(m_drawn) {
+                m_draw.close(p, m_cut);
+            }
+            m_draw.finish();
+        }
+    }
+
+    void proc(ProcImpl* p)
+    {
+        if(m_drawn && !m_cut) {
+            p->accept(&m_draw);
+        }
+    }
+};
+
+FusedPass* fused_ast2dot(DotWriter* out, const DotLimits* limits)
+{
+    return new Ast2dotPass(out, limits);
+}
+
+long count_ast_nodes(Visitable* p)
+{
+    Ast2dot counter(NULL);
+    p->accept(&counter);
+    return counter.last();
+}
+
+void shape_ast(Visitable* p, AstShape* shape)
+{
+    VisitProfiled<Ast2dot, AstShape> walker(shape, (DotWriter*)NULL);
+    p->accept(&walker);
+}
+
+// Run job(i) for every i in [begin, end) on up to nthreads threads
+template<class Job>
+static void run_jobs(int nthreads, size_t begin, size_t end, Job job)
+{
+    std::atomic<size_t> next(begin);
+    std::vector<std::thread> workers;
+    for(int t = 0; t < nthreads; t++) {
+        workers.push_back(std::thread([&]() {
+            for(size_t i = next++; i < end; i = next++) {
+                job(i);
+            }
+        }));
+    }
+    for(size_t t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+}
+
+// Same output as dopass_ast2dot, but each top level procedure is drawn
+// into its own buffer on one of nthreads worker threads.  A counting pass
+// first works out where each procedure's node numbers start, so the
+// buffers can simply be written out in order.
+void dopass_ast2dot_parallel(Program_ptr ast, int fd, int nthreads,
+                             const DotLimits* limits)
+{
+    if(limits != NULL && (limits->max_nodes >= 0 || limits->max_depth == 0)) {
+        // The node budget is one running count over the whole program, and
+        // at depth 0 there are no procedures to split up
+        dopass_ast2dot(ast, fd, limits);
+        return;
+    }
+
+
+    ProgramImpl* prog = dynamic_cast<ProgramImpl*>(ast);
+    assert(prog != NULL);
+    std::vector<Proc_ptr> procs(prog->m_proc_list->begin(),
+                                prog->m_proc_list->end());
+    size_t n = procs.size();
+
+    // Count the nodes under each procedure
+    std::vector<int> first(n + 1);
+    run_jobs(nthreads, 0, n, [&](size_t i) {
+        Ast2dot counter(NULL, limits, 1, 0, 1);
+        procs[i]->accept(&counter);
+        first[i + 1] = counter.last();
+    });
+
+    // ProgramImpl is node 1, so procedure i starts after the nodes of
+    // every procedure before it
+    first[0] = 1;
+    for(size_t i = 0; i < n; i++) {
+        first[i + 1] += first[i];
+    }
+
+    DotWriter out(fd);
+    Ast2dot top(&out);
+    top.start();
+    out.edge(0, 1);
+    out.node(1, "ProgramImpl");
+
+    // Draw a window of procedures at a time so memory stays bounded
+    size_t window = 4 * nthreads;
+    std::vector<DotWriter> parts(window);
+    for(size_t base = 0; base < n; base += window) {
+        size_t end = std::min(n, base + window);
+        run_jobs(nthreads, base, end, [&](size_t i) {
+            Ast2dot a(&parts[i - base], limits, 1, first[i], 1);
+            procs[i]->accept(&a);
+        });
+        for(size_t i = base; i < end; i++) {
+            parts[i - base].append_to(out);
+        }
+    }
+    top.finish();
+}
@@ -0,0 +1,53 @@
+#ifndef AST2DOT_HPP
+#define AST2DOT_HPP
+
+#include <set>
+#include <string>
+
+#include "ast.hpp"
+
+// Limits on how much of the AST dopass_ast2dot draws.  Subtrees cut off by
+// max_depth are replaced by one summary node giving their node count and
+// most common node kinds, which takes a walk of each such subtree.  Nodes
+// past max_nodes, and procedures left out by procs, are not visited at
+// all; a parent missing some children to max_nodes gets one summary node
+// without counts.
+struct DotLimits
+{
+    int max_depth;                  // Deepest node drawn, -1 for no limit
+    int max_nodes;                  // Nodes drawn, -1 for no limit
+    std::set<std::string> procs;    // Top level procedures to draw, empty for all
+
+    DotLimits()
+    {
+        max_depth = -1;
+        max_nodes = -1;
+    }
+};
+
+class VisitProfile;
+
+// With a profile, every visit is counted and timed into it
+void dopass_ast2dot(Program_ptr ast, int fd, const DotLimits* limits = NULL,
+                    VisitProfile* profile = NULL);
+
+// Number of nodes in the subtree at p, p included, as dopass_ast2dot
+// would draw them
+long count_ast_nodes(Visitable* p);
+
+// Walks the same nodes as count_ast_nodes, reporting each one to shape
+class AstShape;
+void shape_ast(Visitable* p, AstShape* shape);
+
+// dopass_ast2dot as a pass for PassManager, drawing into out
+class DotWriter;
+class FusedPass;
+FusedPass* fused_ast2dot(DotWriter* out, const DotLimits* limits = NULL);
+
+// Draws each top level procedure on one of nthreads threads.  The output is
+// identical to dopass_ast2dot, which it falls back to when max_nodes is set
+// (the node budget is one running count across procedures).
+void dopass_ast2dot_parallel(Program_ptr ast, int fd, int nthreads,
+                             const DotLimits* limits = NULL);
+
+#endif //AST2DOT_HPP
@@ -0,0 +1,383 @@
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ast.hpp"
+#include "symtab.hpp"
+#include "primitive.hpp"
+#include "sourcemap.hpp"
+#include "astbin.hpp"
+#include "resourcelimits.hpp"
+
+static const char astbin_magic[8] = { 'C', 'S', 'A', 'S', 'T', 0, 0, 2 };
+static const unsigned long astbin_header = 32;
+
+AstBinWriter::AstBinWriter()
+{
+    m_buf.assign(astbin_header, '\0');
+    memcpy(&m_buf[0], astbin_magic, sizeof(astbin_magic));
+}
+
+void AstBinWriter::put_varint(unsigned long v)
+{
+    while(v >= 0x80) {
+        m_buf.push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+    m_buf.push_back((char)v);
+}
+
+void AstBinWriter::put_u32(unsigned long at, unsigned long v)
+{
+    for(int i = 0; i < 4; i++) {
+        m_buf[at + i] = (char)(v >> (8 * i));
+    }
+}
+
+unsigned long AstBinWriter::intern(const char* s)
+{
+    std::map<std::string, unsigned long>::iterator i = m_string_index.find(s);
+    if(i != m_string_index.end()) {
+        return i->second;
+    }
+    unsigned long index = m_strings.size();
+    m_strings.push_back(s);
+    m_string_index[s] = index;
+    return index;
+}
+
+void AstBinWriter::node(AstKind kind, const Attribute& attribute, size_t mark)
+{
+    unsigned long start = m_buf.size();
+    put_varint(kind);
+    m_buf.push_back((char)attribute.m_basetype);
+    put_varint(attribute.m_offset);
+    const char* layout = ast_bin_layout[kind];
+    assert(layout);
+    size_t r = mark;
+    for(const char* f = layout; *f; f++) {
+        unsigned long n = 1;
+        if(*f == '*') {
+            n = m_refs[r++];
+            put_varint(n);
+        }
+        for(unsigned long i = 0; i < n; i++) {
+            put_varint(start - m_refs[r++]);
+        }
+    }
+    assert(r == m_refs.size());
+    m_refs.resize(mark);
+    m_refs.push_back(start);
+}
+
+void AstBinWriter::text(AstKind kind, const char* s)
+{
+    m_refs.push_back(m_buf.size());
+    put_varint(kind);
+    m_buf.push_back((char)bt_undef);
+    put_varint(0);
+    put_varint(intern(s));
+}
+
+void AstBinWriter::value(AstKind kind, int v)
+{
+    m_refs.push_back(m_buf.size());
+    put_varint(kind);
+    m_buf.push_back((char)bt_undef);
+    put_varint(0);
+    // Zigzag, so that small negative numbers stay short
+    put_varint(((unsigned long)v << 1) ^ (unsigned long)(long)(v >> 31));
+}
+
+const std::string& AstBinWriter::finish()
+{
+    assert(m_refs.size() == 1);
+    const std::vector<unsigned int>& starts = source_map.starts();
+    unsigned long lines = m_buf.size();
+    m_buf.append(4 * starts.size(), '\0');
+    for(size_t i = 0; i < starts.size(); i++) {
+        put_u32(lines + 4 * i, starts[i]);
+    }
+    unsigned long strings = m_buf.size();
+    m_buf.append(4 * m_strings.size(), '\0');
+    for(size_t i = 0; i < m_strings.size(); i++) {
+        put_u32(strings + 4 * i, m_buf.size());
+        m_buf.append(m_strings[i].c_str(), m_strings[i].size() + 1);
+    }
+    put_u32(8, m_refs[0]);
+    put_u32(12, starts.size());
+    put_u32(16, lines);
+    put_u32(20, m_strings.size());
+    put_u32(24, strings);
+    put_u32(28, m_buf.size());
+    return m_buf;
+}
+
+// The generated visitor with the external classes filled in
+class AstBinTreeWriter : public AstBinVisitor
+{
+  public:
+    AstBinTreeWriter(AstBinWriter* w) { m_w = w; }
+
+    void visitSymName(SymName* p) { m_w->text(ast_kind_SymName, p->spelling()); }
+    void visitPrimitive(Primitive* p) { m_w->value(ast_kind_Primitive, p->m_data); }
+    void visitStringPrimitive(StringPrimitive* p)
+    {
+        m_w->text(ast_kind_StringPrimitive, p->m_string);
+    }
+};
+
+bool ast_bin_write(Program_ptr ast, const char* path)
+{
+    AstBinWriter w;
+    AstBinTreeWriter v(&w);
+    ast->accept(&v);
+    const std::string& buf = w.finish();
+
+    FILE* f = fopen(path, "wb");
+    if(f == NULL || fwrite(buf.data(), 1, buf.size(), f) != buf.size()
+            || fclose(f) != 0) {
+        perror(path);
+        return false;
+    }
+    return true;
+}
+
+AstBinFile::AstBinFile(const char* path)
+{
+    m_path = path;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        exit(1);
+    }
+    m_size = st.st_size;
+    if(m_size < astbin_header) {
+        fprintf(stderr, "%s: not a binary AST\n", path);
+        exit(1);
+    }
+    void* data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        perror(path);
+        exit(1);
+    }
+    m_data = (const unsigned char*)data;
+    if(memcmp(m_data, astbin_magic, 7) != 0) {
+        fprintf(stderr, "%s: not a binary AST\n", path);
+        exit(1);
+    }
+    if(m_data[7] != astbin_magic[7]) {
+        fprintf(stderr, "%s: binary AST version %d, expected %d\n", path,
+                m_data[7], astbin_magic[7]);
+        exit(1);
+    }
+
+    unsigned long h[6];
+    for(int i = 0; i < 6; i++) {
+        h[i] = u32(8 + 4 * i);
+    }
+    m_root = h[0];
+    m_nlines = h[1];
+    m_lines = h[2];
+    m_nstrings = h[3];
+    m_strings = h[4];
+    if(h[5] != m_size || m_root < astbin_header || m_root >= m_lines
+            || m_lines + 4 * m_nlines != m_strings
+            || m_strings > m_size || m_nstrings > (m_size - m_strings) / 4) {
+        corrupt(8, "header");
+    }
+}
+
+AstBinFile::~AstBinFile()
+{
+    munmap((void*)m_data, m_size);
+}
+
+unsigned long AstBinFile::u32(unsigned long pos) const
+{
+    const unsigned char* p = m_data + pos;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+void AstBinFile::lines(std::vector<unsigned int>& out) const
+{
+    out.resize(m_nlines);
+    for(unsigned long i = 0; i < m_nlines; i++) {
+        out[i] = u32(m_lines + 4 * i);
+        if(i > 0 && out[i] <= out[i - 1]) {
+            corrupt(m_lines + 4 * i, "line");
+        }
+    }
+}
+
+void AstBinFile::corrupt(unsigned long pos, const char* what) const
+{
+    fprintf(stderr, "%s: corrupt binary AST: bad %s at offset %lu\n",
+            m_path.c_str(), what, pos);
+    exit(1);
+}
+
+// Nodes end where the line table starts
+unsigned char AstBinFile::byte(unsigned long& pos) const
+{
+    if(pos >= m_lines) {
+        corrupt(pos, "node");
+    }
+    return m_data[pos++];
+}
+
+unsigned long AstBinFile::varint(unsigned long& pos) const
+{
+    unsigned long v = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+        unsigned char b = byte(pos);
+        v |= (unsigned long)(b & 0x7f) << shift;
+        if(!(b & 0x80)) {
+            return v;
+        }
+    }
+    corrupt(pos, "number");
+    return 0;
+}
+
+const char* AstBinFile::string(unsigned long index) const
+{
+    if(index >= m_nstrings) {
+        corrupt(m_strings, "string index");
+    }
+    unsigned long at = u32(m_strings + 4 * index);
+    if(at < m_strings || at >= m_size
+            || memchr(m_data + at, 0, m_size - at) == NULL) {
+        corrupt(m_strings + 4 * index, "string");
+    }
+    return (const char*)m_data + at;
+}
+
+AstBinNode::AstBinNode(const AstBinFile* file, unsigned long pos)
+{
+    m_file = file;
+    m_pos = pos;
+    unsigned long kind = file->varint(pos);
+    if(kind >= (unsigned long)ast_num_visit_kinds) {
+        file->corrupt(m_pos, "node kind");
+    }
+    m_kind = (AstKind)kind;
+    unsigned char basetype = file->byte(pos);
+    if(basetype > bt_error) {
+        file->corrupt(m_pos, "basetype");
+    }
+    m_basetype = (Basetype)basetype;
+    unsigned long offset = file->varint(pos);
+    if(offset > 0xffffffffUL) {
+        file->corrupt(m_pos, "offset");
+    }
+    m_offset = offset;
+    m_fields = pos;
+}
+
+const char* AstBinNode::text() const
+{
+    unsigned long pos = m_fields;
+    return m_file->string(m_file->varint(pos));
+}
+
+int AstBinNode::value() const
+{
+    unsigned long pos = m_fields;
+    unsigned long v = m_file->varint(pos);
+    return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+void AstBinNode::restore(Attribute& attribute) const
+{
+    attribute.m_basetype = m_basetype;
+    attribute.m_offset = m_offset;
+}
+
+AstBinNode AstBinFields::child()
+{
+    unsigned long at = m_pos;
+    unsigned long back = m_node.file()->varint(m_pos);
+    // Children come before their parent, so the walk always ends
+    if(back == 0 || back > m_node.pos() - astbin_header) {
+        m_node.file()->corrupt(at, "child");
+    }
+    return AstBinNode(m_node.file(), m_node.pos() - back);
+}
+
+unsigned long AstBinFields::count()
+{
+    unsigned long at = m_pos;
+    unsigned long n = m_node.file()->varint(m_pos);
+    // Each child takes at least a byte
+    if(n > m_node.pos()) {
+        m_node.file()->corrupt(at, "list length");
+    }
+    return n;
+}
+
+void AstBinRebuild::enter(const AstBinNode& n, unsigned int depth)
+{
+    if(resource_limits.depth && depth > resource_limits.depth) {
+        limit_exceeded(limit_depth);
+    }
+    if(m_read[n.pos()]) {
+        n.file()->corrupt(n.pos(), "shared child");
+    }
+    m_read[n.pos()] = true;
+}
+
+void ast_bin_corrupt(const AstBinNode& n, const char* what)
+{
+    std::string s = std::string(ast_visit_names[n.kind()]) + " for a " + what;
+    n.file()->corrupt(n.pos(), s.c_str());
+}
+
+SymName* ast_bin_read_SymName(AstBinRebuild& b, const AstBinNode& n,
+                              unsigned int depth)
+{
+    b.enter(n, depth - 1);     // Leaves add no depth (see ast_depth)
+    if(n.kind() != ast_kind_SymName) {
+        ast_bin_corrupt(n, "SymName");
+    }
+    return new SymName(strdup(n.text()));
+}
+
+Primitive* ast_bin_read_Primitive(AstBinRebuild& b, const AstBinNode& n,
+                                  unsigned int depth)
+{
+    b.enter(n, depth - 1);     // Leaves add no depth (see ast_depth)
+    if(n.kind() != ast_kind_Primitive) {
+        ast_bin_corrupt(n, "Primitive");
+    }
+    return new Primitive(n.value());
+}
+
+StringPrimitive* ast_bin_read_StringPrimitive(AstBinRebuild& b,
+                                              const AstBinNode& n,
+                                              unsigned int depth)
+{
+    b.enter(n, depth - 1);     // Leaves add no depth (see ast_depth)
+    if(n.kind() != ast_kind_StringPrimitive) {
+        ast_bin_corrupt(n, "StringPrimitive");
+    }
+    return new StringPrimitive(strdup(n.text()));
+}
+
+Program_ptr ast_bin_read(const char* path)
+{
+    AstBinFile file(path);
+    std::vector<unsigned int> lines;
+    file.lines(lines);
+    source_map.assign(lines);
+    AstBinRebuild b(&file);
+    return ast_bin_read_Program(b, AstBinNode(&file, file.root()), 1);
+}
@@ -0,0 +1,177 @@
+#ifndef ASTBIN_HPP
+#define ASTBIN_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "ast.hpp"
+#include "attribute.hpp"
+
+// Binary form of a checked AST (--ast-out, --ast-in), so other tools can
+// load the tree without the scanner and parser.  The writer and reader of
+// each class are generated from ast.cdef by astbuilder.gawk; this file has
+// the encoding they share.
+//
+// All numbers are little endian.  The file starts with a 32 byte header:
+//
+//     "CSAST" 0 0 <version>        8 bytes
+//     u32 root                     offset of the Program node
+//     u32 nlines, u32 lines        the line table and its offset
+//     u32 nstrings, u32 strings    the string table and its offset
+//     u32 size                     of the whole file
+//
+// then the nodes, each one after all of its children:
+//
+//     varint kind                  an AstKind
+//     u8 basetype, varint offset   the node's Attribute
+//     fields                       in ast.cdef order (see ast_bin_layout)
+//
+// A child is the varint distance back from the node's start to the
+// child's, and a list is a varint count followed by its children.  As
+// every reference points backwards, a reader can start at the root and
+// walk any part of the tree in place.  A SymName or StringPrimitive holds
+// the varint index of its text in the string table, and a Primitive its
+// value as a zigzag varint.  The line table is source_map, the u32 source
+// offset of each line after the first.  The string table is nstrings u32
+// offsets followed by the NUL terminated strings, each stored once.
+
+// Builds a file in memory; fed by AstBinVisitor
+class AstBinWriter
+{
+  private:
+    std::string m_buf;
+    // The starts of nodes whose parents are not written yet, with the
+    // counts of their lists in between
+    std::vector<unsigned long> m_refs;
+    std::vector<std::string> m_strings;
+    std::map<std::string, unsigned long> m_string_index;
+
+    void put_varint(unsigned long v);
+    void put_u32(unsigned long at, unsigned long v);
+    unsigned long intern(const char* s);
+
+  public:
+    AstBinWriter();
+
+    // Where the fields of the next node start, for node
+    size_t mark() { return m_refs.size(); }
+    // The next field is a list of n
+    void count(size_t n) { m_refs.push_back(n); }
+    // A node whose fields have been written since mark
+    void node(AstKind kind, const Attribute& attribute, size_t mark);
+    // A node that holds a string or a number
+    void text(AstKind kind, const char* s);
+    void value(AstKind kind, int v);
+
+    // The finished file, with root the last node written and the lines of
+    // source_map
+    const std::string& finish();
+};
+
+// Write ast to path; returns false and says why if it cannot
+bool ast_bin_write(Program_ptr ast, const char* path);
+
+// Load the tree in the file at path, and its lines into source_map,
+// exiting if it is not a valid file.  That includes a node that is the
+// child of two parents: shared children could make a small file rebuild
+// an exponentially large tree.
+Program_ptr ast_bin_read(const char* path);
+
+// A binary AST mapped into memory.  The header is checked on open; every
+// other read is bounds checked as it is made, and a file that turns out
+// to be corrupt is reported and csimple exits.
+class AstBinFile
+{
+  private:
+    std::string m_path;
+    const unsigned char* m_data;
+    unsigned long m_size;
+    unsigned long m_root;
+    unsigned long m_nlines;
+    unsigned long m_lines;
+    unsigned long m_nstrings;
+    unsigned long m_strings;
+
+  public:
+    AstBinFile(const char* path);
+    ~AstBinFile();
+
+    const char* path() const { return m_path.c_str(); }
+    unsigned long root() const { return m_root; }
+    unsigned long size() const { return m_size; }
+    void lines(std::vector<unsigned int>& out) const;
+
+    unsigned long u32(unsigned long pos) const;
+    unsigned long varint(unsigned long& pos) const;
+    unsigned char byte(unsigned long& pos) const;
+    const char* string(unsigned long index) const;
+    void corrupt(unsigned long pos, const char* what) const;
+};
+
+// The node starting at pos, with its tag and attribute decoded
+class AstBinNode
+{
+  private:
+    const AstBinFile* m_file;
+    unsigned long m_pos;
+    AstKind m_kind;
+    Basetype m_basetype;
+    unsigned int m_offset;
+    unsigned long m_fields;     // Where the fields start
+
+  public:
+    AstBinNode(const AstBinFile* file, unsigned long pos);
+
+    const AstBinFile* file() const { return m_file; }
+    unsigned long pos() const { return m_pos; }
+    unsigned long fields() const { return m_fields; }
+    AstKind kind() const { return m_kind; }
+    Basetype basetype() const { return m_basetype; }
+    unsigned int offset() const { return m_offset; }
+
+    // The string of a SymName or StringPrimitive
+    const char* text() const;
+    // The number of a Primitive
+    int value() const;
+
+    // Give a rebuilt node the attribute that was written
+    void restore(Attribute& attribute) const;
+};
+
+// Reads the fields of a node in order
+class AstBinFields
+{
+  private:
+    const AstBinNode& m_node;
+    unsigned long m_pos;
+
+  public:
+    AstBinFields(const AstBinNode& node) : m_node(node), m_pos(node.fields()) {}
+
+    // The next field, a child
+    AstBinNode child();
+    // The next field, a list: its length, then that many child() calls
+    unsigned long count();
+};
+
+// One ast_bin_read: the generated readers (ast.cpp) enter each node they
+// rebuild here, depth levels down (the root is 1), before they read its
+// children.  A node entered twice is reported as corrupt, and one deeper
+// than --max-depth exits as the AST constructors would, but before the
+// readers' recursion can exhaust the stack.
+class AstBinRebuild
+{
+  private:
+    std::vector<bool> m_read;   // By node start
+
+  public:
+    AstBinRebuild(const AstBinFile* file) : m_read(file->size()) {}
+
+    void enter(const AstBinNode& n, unsigned int depth);
+};
+
+// A node of kind where a what belongs: report and exit
+void ast_bin_corrupt(const AstBinNode& n, const char* what);
+
+#endif //ASTBIN_HPP
@@ -17,7 +17,8 @@ enum Basetype
     bt_charptr,
     bt_procedure,
     bt_ptr,             // Used by nullptr
-    bt_string
+    bt_string,
+    bt_error            // A subtree with a type error already reported
 };
 
 
@@ -27,11 +28,19 @@ class Attribute
   Basetype m_basetype;  // Type of the subtree
   int m_place;          // Register where this value is stored
   SymScope* m_scope;    // The scope of the current symbol
-  int lineno;           // Line number on which that ast node resides
+  unsigned int m_offset; // Where the node's first token starts in the
+                         // input; see sourcemap.hpp for its line
+  unsigned int m_depth : 24; // Of the subtree, 1 for a leaf
+  unsigned int m_kind : 8;   // The node's AstKind, for StaticVisitor
+
+  // The deepest subtree m_depth can hold
+  static const unsigned int max_depth = (1 << 24) - 1;
 
   Attribute() {
     m_basetype = bt_undef;
-    lineno = 0;
+    m_offset = 0;
+    m_depth = 0;
+    m_kind = 0;
     m_scope = NULL;
     int m_place = -1;   // Should never actually be negative
   }
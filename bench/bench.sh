@@ -0,0 +1,79 @@
+#!/bin/sh
+#
+# End to end benchmark for csimple (run with "make bench").
+#
+# Generates the corpora below with bench/proggen.gawk, runs csimple on each
+# one stopping after every phase in turn (lex, parse, typecheck, ast2dot)
+# and records the best of BENCH_REPEAT runs.  Each line of the results is
+#
+#   corpus  phase  bytes  wall_s  cpu_s  maxrss_kb  MB/s  status
+#
+# where the times cover everything up to and including that phase.
+# Results go to bench/results/<commit>.tsv; compare two runs with
+#
+#   sh bench/bench.sh compare bench/results/OLD.tsv bench/results/NEW.tsv
+#
+
+GAWK=${GAWK:-gawk}
+CSIMPLE=${CSIMPLE:-./csimple}
+RUNSTAT=${RUNSTAT:-bench/runstat}
+REPEAT=${BENCH_REPEAT:-3}
+CORPUS=bench/corpus
+RESULTS=bench/results
+
+if [ "$1" = "compare" ]; then
+    # wall time and peak RSS of NEW relative to OLD, per corpus and phase
+    $GAWK 'FNR == 1 { f++ } /^#/ { next }
+        f == 1 { w[$1 " " $2] = $4; m[$1 " " $2] = $6; next }
+        ($1 " " $2) in w {
+            printf "%-14s %-10s %9.4fs -> %9.4fs (x%.2f)  %8dkB -> %8dkB\n",
+                $1, $2, w[$1 " " $2], $4, $4 / (w[$1 " " $2] ? w[$1 " " $2] : 1),
+                m[$1 " " $2], $6
+        }' "$2" "$3"
+    exit 0
+fi
+
+# name and proggen.gawk knobs for each corpus
+corpora() {
+    cat <<END
+small      -v procs=100
+wide       -v procs=5000 -v depth=1
+deep       -v procs=500 -v depth=8 -v stmts=4
+longexpr   -v procs=1000 -v exprlen=64
+manyids    -v procs=1000 -v idents=200
+comments   -v procs=2000 -v comments=0.8
+strings    -v procs=2000 -v strsize=4096
+invalid    -v procs=5000 -v invalid=1
+END
+}
+
+mkdir -p $CORPUS $RESULTS
+rev=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+out=$RESULTS/$rev.tsv
+echo "# csimple benchmark $rev $(date -u +%Y-%m-%dT%H:%M:%SZ)" > $out
+
+corpora | while read name knobs; do
+    src=$CORPUS/$name.csimple
+    [ -f $src ] || $GAWK -f bench/proggen.gawk $knobs > $src
+    bytes=$(wc -c < $src)
+    for phase in lex parse typecheck ast2dot; do
+        best=
+        i=0
+        while [ $i -lt $REPEAT ]; do
+            if [ $phase = ast2dot ]; then
+                r=$($RUNSTAT $src $CSIMPLE)
+            else
+                r=$($RUNSTAT $src $CSIMPLE --stop-after=$phase)
+            fi
+            best=$(printf "%s\n%s\n" "$best" "$r" | sort -n | grep . | head -1)
+            i=$((i + 1))
+        done
+        echo "$name $phase $bytes $best" | $GAWK '{
+            printf "%s\t%s\t%d\t%s\t%s\t%s\t%.2f\t%s\n", $1, $2, $3, $4, $5, $6,
+                $3 / 1048576 / ($4 > 0 ? $4 : 1e-9), $7 }'
+    done
+done | tee -a $out | $GAWK -F'\t' '{
+    printf "%-10s %-10s %10d B %9.4fs wall %9.4fs cpu %8d kB %8.2f MB/s  exit %d\n",
+        $1, $2, $3, $4, $5, $6, $7, $8 }'
+
+echo "results in $out"
@@ -0,0 +1,165 @@
+/**
+ *  Compares the latency of checking one program by starting csimple each
+ *  time with sending it to a csimple --daemon, runs times each way:
+ *
+ *      <mode> <runs> <p50_us> <p90_us> <p99_us> <max_us>
+ *
+ *  Each spawn runs "csimple --check-only [args...] < input"; the daemon is
+ *  started once as "csimple --daemon [args...]" and each request is timed
+ *  from writing it to reading the whole reply.
+ *
+ *  usage: daemon_latency input runs csimple [args...]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static double micros(Clock::time_point since)
+{
+    return std::chrono::duration<double, std::micro>(Clock::now() - since).count();
+}
+
+static void report(const char* mode, std::vector<double>& t)
+{
+    std::sort(t.begin(), t.end());
+    size_t n = t.size();
+    printf("%-7s %6lu %9.1f %9.1f %9.1f %9.1f\n", mode, (unsigned long)n,
+           t[n / 2], t[n * 9 / 10], t[std::min(n - 1, n * 99 / 100)], t[n - 1]);
+}
+
+static void write_all(int fd, const char* s, size_t len)
+{
+    while(len > 0) {
+        ssize_t n = write(fd, s, len);
+        if(n <= 0) {
+            perror("write");
+            exit(1);
+        }
+        s += n;
+        len -= n;
+    }
+}
+
+static void read_all(FILE* f, size_t len)
+{
+    char buf[65536];
+    while(len > 0) {
+        size_t n = fread(buf, 1, std::min(len, sizeof(buf)), f);
+        if(n == 0) {
+            fprintf(stderr, "daemon closed the pipe\n");
+            exit(1);
+        }
+        len -= n;
+    }
+}
+
+// argv for csimple with mode inserted after the program name
+static std::vector<char*> command(char** argv, const char* mode)
+{
+    std::vector<char*> cmd;
+    cmd.push_back(argv[0]);
+    cmd.push_back((char*)mode);
+    for(char** a = argv + 1; *a; a++) {
+        cmd.push_back(*a);
+    }
+    cmd.push_back(NULL);
+    return cmd;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 4) {
+        fprintf(stderr, "usage: %s input runs csimple [args...]\n", argv[0]);
+        return 1;
+    }
+    const char* input = argv[1];
+    int runs = atoi(argv[2]);
+    std::string program;
+    FILE* in = fopen(input, "r");
+    if(in == NULL || runs < 1) {
+        perror(input);
+        return 1;
+    }
+    char buf[65536];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        program.append(buf, n);
+    }
+    fclose(in);
+
+    std::vector<double> spawn;
+    std::vector<char*> check = command(argv + 3, "--check-only");
+    for(int i = 0; i < runs; i++) {
+        Clock::time_point start = Clock::now();
+        pid_t pid = fork();
+        if(pid == 0) {
+            int fd = open(input, O_RDONLY);
+            int null = open("/dev/null", O_WRONLY);
+            dup2(fd, STDIN_FILENO);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            execvp(check[0], &check[0]);
+            _exit(127);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        spawn.push_back(micros(start));
+    }
+
+    int to[2], from[2];
+    if(pipe(to) < 0 || pipe(from) < 0) {
+        perror("pipe");
+        return 1;
+    }
+    std::vector<char*> serve = command(argv + 3, "--daemon");
+    pid_t pid = fork();
+    if(pid == 0) {
+        dup2(to[0], STDIN_FILENO);
+        dup2(from[1], STDOUT_FILENO);
+        close(to[1]);
+        close(from[0]);
+        execvp(serve[0], &serve[0]);
+        _exit(127);
+    }
+    close(to[0]);
+    close(from[1]);
+    FILE* replies = fdopen(from[0], "r");
+    std::string request = "check " + std::to_string(program.size()) + "\n"
+                        + program;
+
+    std::vector<double> daemon;
+    for(int i = 0; i < runs; i++) {
+        Clock::time_point start = Clock::now();
+        write_all(to[1], request.data(), request.size());
+        int status;
+        unsigned long nout, nerr;
+        // Not "\n" in the format, which would also skip leading blanks of
+        // the reply's body
+        if(fscanf(replies, "%d %lu %lu", &status, &nout, &nerr) != 3
+                || fgetc(replies) != '\n') {
+            fprintf(stderr, "bad reply from daemon\n");
+            return 1;
+        }
+        read_all(replies, nout + nerr);
+        daemon.push_back(micros(start));
+    }
+    write_all(to[1], "quit\n", 5);
+    close(to[1]);
+    waitpid(pid, NULL, 0);
+
+    printf("%-7s %6s %9s %9s %9s %9s\n", "mode", "runs", "p50_us", "p90_us",
+           "p99_us", "max_us");
+    report("spawn", spawn);
+    report("daemon", daemon);
+    return 0;
+}
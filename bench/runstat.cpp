@@ -0,0 +1,60 @@
+/**
+ *  Runs a command with stdin from a file and stdout discarded, then prints
+ *  its wall time, CPU time (user + system), peak RSS and exit status:
+ *
+ *      <wall_s> <cpu_s> <maxrss_kb> <status>
+ *
+ *  usage: runstat input command [args...]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int main(int argc, char** argv)
+{
+    if(argc < 3) {
+        fprintf(stderr, "usage: %s input command [args...]\n", argv[0]);
+        return 1;
+    }
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if(pid == 0) {
+        int in = open(argv[1], O_RDONLY);
+        int out = open("/dev/null", O_WRONLY);
+        if(in < 0 || out < 0) {
+            perror(argv[1]);
+            _exit(127);
+        }
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        dup2(out, STDERR_FILENO);
+        execvp(argv[2], argv + 2);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage ru;
+    if(wait4(pid, &status, 0, &ru) < 0) {
+        perror("wait4");
+        return 1;
+    }
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+    double cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6
+               + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+
+    printf("%.4f %.4f %ld %d\n", wall.count(), cpu, ru.ru_maxrss,
+           WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+    return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ *  Microbenchmark for global-scope procedure lookups.  Registers a large
+ *  number of procedures in the outermost scope, then times the same lookup
+ *  sequence against the live scope and against the frozen one.
+ *
+ *  usage: symtab_bench [nprocs] [nlookups]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../symtab.hpp"
+
+static double time_lookups(SymTab& st, SymScope* scope,
+                           std::vector<char*>& names,
+                           std::vector<int>& order, long* found)
+{
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for(size_t i = 0; i < order.size(); i++) {
+        if(st.lookup(scope, names[order[i]]) != NULL) {
+            (*found)++;
+        }
+    }
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    return d.count();
+}
+
+int main(int argc, char** argv)
+{
+    int nprocs = argc > 1 ? atoi(argv[1]) : 50000;
+    int nlookups = argc > 2 ? atoi(argv[2]) : 5000000;
+
+    SymTab st;
+    std::vector<char*> names;
+    char buf[32];
+    for(int i = 0; i < nprocs; i++) {
+        snprintf(buf, sizeof(buf), "proc_%d", i);
+        Symbol* s = new Symbol();
+        s->m_basetype = bt_procedure;
+        st.insert(strdup(buf), s);
+        names.push_back(strdup(buf));
+    }
+    // Roughly one miss in eight, like calls to not-yet-defined procedures
+    for(int i = 0; i < nprocs / 8; i++) {
+        snprintf(buf, sizeof(buf), "missing_%d", i);
+        names.push_back(strdup(buf));
+    }
+
+    std::vector<int> order(nlookups);
+    srand(160);
+    for(int i = 0; i < nlookups; i++) {
+        order[i] = rand() % names.size();
+    }
+
+    SymScope* global = st.get_scope();
+    long found_live = 0, found_frozen = 0;
+    double live = time_lookups(st, global, names, order, &found_live);
+    st.freeze(global);
+    double frozen = time_lookups(st, global, names, order, &found_frozen);
+
+    if(found_live != found_frozen) {
+        fprintf(stderr, "error: frozen scope found %ld symbols, live found %ld\n",
+                found_frozen, found_live);
+        return 1;
+    }
+
+    printf("procedures: %d  lookups: %d  hits: %ld\n",
+           nprocs, nlookups, found_live);
+    printf("unordered_map: %8.3f s  %8.1f ns/lookup\n",
+           live, live * 1e9 / nlookups);
+    printf("frozen:        %8.3f s  %8.1f ns/lookup\n",
+           frozen, frozen * 1e9 / nlookups);
+    return 0;
+}
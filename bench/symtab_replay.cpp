@@ -0,0 +1,119 @@
+/**
+ *  Replays a symbol table trace against the SymTab it is linked with.  The
+ *  Makefile builds one copy per storage policy in scopetable.hpp
+ *  (symtab_replay_node, _flat and _linear); run each on the same trace to
+ *  compare them.  Capture a trace with "csimple --symtab-trace=FILE".
+ *
+ *  usage: symtab_replay_<policy> trace [repeat]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../symtab.hpp"
+
+#define STR(x) #x
+#define XSTR(x) STR(x)
+
+struct TraceOp
+{
+    char op;            // o, c, i, p, l or f as written by SymTab::set_trace
+    std::string name;
+};
+
+static bool read_trace(const char* path, std::vector<TraceOp>& ops)
+{
+    FILE* f = fopen(path, "r");
+    if(f == NULL) {
+        return false;
+    }
+    char line[4096];
+    while(fgets(line, sizeof(line), f)) {
+        TraceOp t;
+        t.op = line[0];
+        if(line[1] == ' ') {
+            t.name = line + 2;
+            t.name.erase(t.name.find_last_not_of("\n") + 1);
+        }
+        ops.push_back(t);
+    }
+    fclose(f);
+    return true;
+}
+
+// Each insert gets a symbol of its own, as in a real run
+static Symbol* new_symbol(std::vector<Symbol*>& symbols)
+{
+    Symbol* s = new Symbol();
+    s->m_basetype = bt_integer;
+    symbols.push_back(s);
+    return s;
+}
+
+static long replay(std::vector<TraceOp>& ops)
+{
+    SymTab st;
+    std::vector<Symbol*> symbols;
+    long hits = 0;
+    for(size_t i = 0; i < ops.size(); i++) {
+        switch(ops[i].op) {
+            case 'o':
+                st.open_scope();
+                break;
+            case 'c':
+                st.close_scope();
+                break;
+            case 'i':
+                st.insert(strdup(ops[i].name.c_str()), new_symbol(symbols));
+                break;
+            case 'p':
+                st.insert_in_parent_scope(strdup(ops[i].name.c_str()),
+                                          new_symbol(symbols));
+                break;
+            case 'l':
+                if(st.lookup(ops[i].name.c_str()) != NULL) {
+                    hits++;
+                }
+                break;
+            case 'f':
+                st.freeze(st.get_scope());
+                break;
+        }
+    }
+    for(size_t i = 0; i < symbols.size(); i++) {
+        delete symbols[i];
+    }
+    return hits;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s trace [repeat]\n", argv[0]);
+        return 1;
+    }
+    int repeat = argc > 2 ? atoi(argv[2]) : 10;
+
+    std::vector<TraceOp> ops;
+    if(!read_trace(argv[1], ops)) {
+        fprintf(stderr, "error: cannot read trace %s\n", argv[1]);
+        return 1;
+    }
+
+    long hits = 0;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for(int r = 0; r < repeat; r++) {
+        hits = replay(ops);
+    }
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+
+    printf("%-14s ops: %zu  hits: %ld  %8.3f s  %8.1f ns/op\n",
+           XSTR(SYMTAB_POLICY), ops.size(), hits, d.count() / repeat,
+           d.count() * 1e9 / repeat / (ops.empty() ? 1 : ops.size()));
+    return 0;
+}
@@ -0,0 +1,193 @@
+/**
+ *  Microbenchmark for the two ways of walking the AST.  Builds a forest of
+ *  random expressions, then times the same typing rules (a cut down
+ *  typecheck of the arithmetic, comparison and logic operators) run by a
+ *  Visitor, one virtual call per node, and by a StaticVisitor, which
+ *  dispatches with a switch on the node's kind tag.
+ *
+ *  usage: visit_bench [nodes] [runs]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../ast.hpp"
+#include "../primitive.hpp"
+
+// Where nodes built here start in the (nonexistent) input
+unsigned int ast_offset = 0;
+
+// A Visitor reaching each child with a virtual accept, as typecheck's
+// profiled walk does
+class VirtualWalk : public WalkVisitor
+{
+  public:
+    template<class T> void visit(T* p) { p->accept(this); }
+};
+
+template<class Walk>
+class ExprTypes : public Walk
+{
+  private:
+    void binary(Expr* p, Expr* a, Expr* b, Basetype operand, Basetype result)
+    {
+        this->visit(a);
+        this->visit(b);
+        p->m_attribute.m_basetype =
+            a->m_attribute.m_basetype == operand
+            && b->m_attribute.m_basetype == operand ? result : bt_error;
+        m_nodes++;
+    }
+
+  public:
+    long m_nodes;
+
+    ExprTypes() : m_nodes(0) {}
+
+    void visitIntLit(IntLit* p)
+    {
+        p->m_attribute.m_basetype = bt_integer;
+        m_nodes++;
+    }
+    void visitBoolLit(BoolLit* p)
+    {
+        p->m_attribute.m_basetype = bt_boolean;
+        m_nodes++;
+    }
+    void visitNot(Not* p)
+    {
+        this->visit(p->m_expr);
+        p->m_attribute.m_basetype =
+            p->m_expr->m_attribute.m_basetype == bt_boolean
+            ? bt_boolean : bt_error;
+        m_nodes++;
+    }
+    void visitPlus(Plus* p)
+    {
+        binary(p, p->m_expr_1, p->m_expr_2, bt_integer, bt_integer);
+    }
+    void visitMinus(Minus* p)
+    {
+        binary(p, p->m_expr_1, p->m_expr_2, bt_integer, bt_integer);
+    }
+    void visitTimes(Times* p)
+    {
+        binary(p, p->m_expr_1, p->m_expr_2, bt_integer, bt_integer);
+    }
+    void visitLt(Lt* p)
+    {
+        binary(p, p->m_expr_1, p->m_expr_2, bt_integer, bt_boolean);
+    }
+    void visitAnd(And* p)
+    {
+        binary(p, p->m_expr_1, p->m_expr_2, bt_boolean, bt_boolean);
+    }
+    void visitOr(Or* p)
+    {
+        binary(p, p->m_expr_1, p->m_expr_2, bt_boolean, bt_boolean);
+    }
+};
+
+class VirtualExprTypes : public ExprTypes<VirtualWalk>
+{
+};
+
+class StaticExprTypes : public ExprTypes<StaticVisitor<StaticExprTypes> >
+{
+};
+
+// A random expression of at most depth levels, mostly well typed
+static Expr* build(int depth, Basetype type, long* nodes)
+{
+    (*nodes)++;
+    if(depth <= 1 || rand() % 8 == 0) {
+        if(type == bt_integer) {
+            return new IntLit(new Primitive(rand() % 100));
+        }
+        return new BoolLit(new Primitive(rand() % 2));
+    }
+    if(type == bt_integer) {
+        Expr* a = build(depth - 1, bt_integer, nodes);
+        Expr* b = build(depth - 1, bt_integer, nodes);
+        switch(rand() % 3) {
+            case 0: return new Plus(a, b);
+            case 1: return new Minus(a, b);
+            default: return new Times(a, b);
+        }
+    }
+    switch(rand() % 4) {
+        case 0: return new Not(build(depth - 1, bt_boolean, nodes));
+        case 1: return new Lt(build(depth - 1, bt_integer, nodes),
+                              build(depth - 1, bt_integer, nodes));
+        case 2: return new And(build(depth - 1, bt_boolean, nodes),
+                               build(depth - 1, bt_boolean, nodes));
+        default: return new Or(build(depth - 1, bt_boolean, nodes),
+                               build(depth - 1, bt_boolean, nodes));
+    }
+}
+
+// Seconds for the fastest of runs walks of the forest with pass
+template<class Pass>
+static double time_walks(std::vector<Expr*>& forest, int runs, long* nodes)
+{
+    double best = 0;
+    for(int r = 0; r < runs; r++) {
+        Pass pass;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        for(size_t i = 0; i < forest.size(); i++) {
+            pass.visit(forest[i]);
+        }
+        std::chrono::duration<double> d =
+            std::chrono::steady_clock::now() - start;
+        if(r == 0 || d.count() < best) {
+            best = d.count();
+        }
+        *nodes = pass.m_nodes;
+    }
+    return best;
+}
+
+static long count_errors(std::vector<Expr*>& forest)
+{
+    long errors = 0;
+    for(size_t i = 0; i < forest.size(); i++) {
+        errors += forest[i]->m_attribute.m_basetype == bt_error;
+        forest[i]->m_attribute.m_basetype = bt_undef;
+    }
+    return errors;
+}
+
+int main(int argc, char** argv)
+{
+    long target = argc > 1 ? atol(argv[1]) : 2000000;
+    int runs = argc > 2 ? atoi(argv[2]) : 5;
+
+    std::vector<Expr*> forest;
+    long built = 0;
+    srand(50);
+    while(built < target) {
+        forest.push_back(build(12, rand() % 2 ? bt_integer : bt_boolean,
+                               &built));
+    }
+
+    long nodes_virtual = 0, nodes_static = 0;
+    double t_virtual =
+        time_walks<VirtualExprTypes>(forest, runs, &nodes_virtual);
+    long errors_virtual = count_errors(forest);
+    double t_static = time_walks<StaticExprTypes>(forest, runs, &nodes_static);
+    long errors_static = count_errors(forest);
+    if(nodes_virtual != nodes_static || errors_virtual != errors_static) {
+        fprintf(stderr, "visit_bench: the two walks disagree\n");
+        return 1;
+    }
+
+    printf("%ld nodes in %zu expressions, best of %d runs\n",
+           nodes_static, forest.size(), runs);
+    printf("virtual %8.2f ns/node\n", t_virtual * 1e9 / nodes_virtual);
+    printf("static  %8.2f ns/node  (x%.2f)\n", t_static * 1e9 / nodes_static,
+           t_virtual / t_static);
+    return 0;
+}
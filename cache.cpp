@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.hpp"
+
+// Entry file layout: this header, then out, err and dot back to back
+struct CacheHeader
+{
+    char magic[8];
+    unsigned long long key;
+    long long status;
+    unsigned long long out_len;
+    unsigned long long err_len;
+    unsigned long long dot_len;
+};
+
+static const char cache_magic[8] = { 'c', 's', 'c', 'a', 'c', 'h', 'e', '1' };
+
+static bool write_all(int fd, const char* buf, size_t len)
+{
+    while(len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, char* buf, size_t len)
+{
+    while(len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if(n <= 0) {
+            if(n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Create dir and any missing parents
+static void make_dirs(const std::string& dir)
+{
+    for(size_t i = 1; i <= dir.size(); i++) {
+        if(i == dir.size() || dir[i] == '/') {
+            mkdir(dir.substr(0, i).c_str(), 0755);
+        }
+    }
+}
+
+ResultCache::ResultCache(const char* dir, long long max_bytes)
+{
+    m_dir = dir;
+    m_max_bytes = max_bytes;
+    make_dirs(m_dir);
+}
+
+unsigned long long ResultCache::hash(const void* data, size_t len,
+                                     unsigned long long seed)
+{
+    const unsigned long long m = 0x9e3779b97f4a7c15ull;
+    const unsigned char* p = (const unsigned char*)data;
+    unsigned long long h = seed ^ (len * m);
+
+    for(; len >= 8; p += 8, len -= 8) {
+        unsigned long long k;
+        memcpy(&k, p, 8);
+        k *= 0xbf58476d1ce4e5b9ull;
+        k ^= k >> 31;
+        h = (h ^ k) * m;
+        h ^= h >> 29;
+    }
+    unsigned long long k = 0;
+    memcpy(&k, p, len);
+    h = (h ^ k) * m;
+
+    // Final mix (from MurmurHash3) so every input bit reaches every output bit
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+std::string ResultCache::build_id()
+{
+    struct stat st;
+    char id[128];
+    if(stat("/proc/self/exe", &st) == 0) {
+        snprintf(id, sizeof(id), "%lld:%lld:%lld.%09ld", (long long)st.st_ino,
+                 (long long)st.st_size, (long long)st.st_mtim.tv_sec,
+                 st.st_mtim.tv_nsec);
+    } else {
+        snprintf(id, sizeof(id), "%s %s", __DATE__, __TIME__);
+    }
+    return id;
+}
+
+std::string ResultCache::path(unsigned long long key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.entry", key);
+    return m_dir + name;
+}
+
+bool ResultCache::lookup(unsigned long long key, Entry& e)
+{
+    int fd = open(path(key).c_str(), O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+    struct stat st;
+    CacheHeader h;
+    bool ok = fstat(fd, &st) == 0
+        && read_all(fd, (char*)&h, sizeof(h))
+        && !memcmp(h.magic, cache_magic, sizeof(h.magic))
+        && h.key == key
+        && (unsigned long long)st.st_size
+           == sizeof(h) + h.out_len + h.err_len + h.dot_len;
+    if(ok) {
+        e.status = (int)h.status;
+        e.out.resize(h.out_len);
+        e.err.resize(h.err_len);
+        e.dot.resize(h.dot_len);
+        ok = read_all(fd, &e.out[0], h.out_len)
+            && read_all(fd, &e.err[0], h.err_len)
+            && read_all(fd, &e.dot[0], h.dot_len);
+    }
+    if(ok) {
+        futimens(fd, NULL);     // Most recently used
+    }
+    close(fd);
+    return ok;
+}
+
+void ResultCache::store(unsigned long long key, const Entry& e)
+{
+    // Something that would not fit would only flush everything else out
+    long long size = sizeof(CacheHeader) + e.out.size() + e.err.size()
+                     + e.dot.size();
+    if(size > m_max_bytes) {
+        return;
+    }
+
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "/.tmp.%d.%016llx", (int)getpid(), key);
+    std::string tmp_path = m_dir + tmp;
+
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        return;
+    }
+    CacheHeader h;
+    memcpy(h.magic, cache_magic, sizeof(h.magic));
+    h.key = key;
+    h.status = e.status;
+    h.out_len = e.out.size();
+    h.err_len = e.err.size();
+    h.dot_len = e.dot.size();
+    bool ok = write_all(fd, (const char*)&h, sizeof(h))
+        && write_all(fd, e.out.data(), e.out.size())
+        && write_all(fd, e.err.data(), e.err.size())
+        && write_all(fd, e.dot.data(), e.dot.size());
+    close(fd);
+    if(!ok || rename(tmp_path.c_str(), path(key).c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return;
+    }
+    evict();
+}
+
+void ResultCache::evict()
+{
+    // One process trims at a time; the others carry on without waiting
+    std::string lock_path = m_dir + "/.lock";
+    int lock = open(lock_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(lock < 0) {
+        return;
+    }
+    if(flock(lock, LOCK_EX | LOCK_NB) != 0) {
+        close(lock);
+        return;
+    }
+
+    struct File
+    {
+        struct timespec mtime;
+        long long size;
+        std::string name;
+    };
+    std::vector<File> files;
+    long long total = 0;
+    DIR* d = opendir(m_dir.c_str());
+    if(d != NULL) {
+        for(struct dirent* de = readdir(d); de != NULL; de = readdir(d)) {
+            size_t n = strlen(de->d_name);
+            if(n < 6 || strcmp(de->d_name + n - 6, ".entry")) {
+                continue;
+            }
+            std::string p = m_dir + "/" + de->d_name;
+            struct stat st;
+            if(stat(p.c_str(), &st) == 0) {
+                File f = { st.st_mtim, (long long)st.st_size, p };
+                files.push_back(f);
+                total += st.st_size;
+            }
+        }
+        closedir(d);
+    }
+
+    if(total > m_max_bytes) {
+        // Oldest first, and trim to 90% so the next store does not have to
+        std::sort(files.begin(), files.end(), [](const File& a, const File& b) {
+            return a.mtime.tv_sec != b.mtime.tv_sec
+                ? a.mtime.tv_sec < b.mtime.tv_sec
+                : a.mtime.tv_nsec < b.mtime.tv_nsec;
+        });
+        for(size_t i = 0; i < files.size() && total > m_max_bytes / 10 * 9; i++) {
+            if(unlink(files[i].name.c_str()) == 0) {
+                total -= files[i].size;
+            }
+        }
+    }
+    flock(lock, LOCK_UN);
+    close(lock);
+}
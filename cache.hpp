@@ -0,0 +1,51 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <string>
+
+// On-disk cache of whole csimple runs for --cache-dir.  An entry is keyed
+// by a hash of the program text, the options that change the output and
+// the csimple binary itself, and holds the exit code and everything the
+// run wrote (stdout, stderr and the --dot-out file).
+//
+// Entries are written to a temporary file and renamed into place, so
+// parallel processes never see half an entry.  Hits refresh the entry's
+// mtime; when the directory grows past its size cap the least recently
+// used entries are removed by whichever process holds the directory lock.
+// The cache is only an accelerator: any I/O problem is a miss.
+class ResultCache
+{
+  public:
+    struct Entry
+    {
+        int status;             // exit code
+        std::string out;        // stdout
+        std::string err;        // stderr
+        std::string dot;        // --dot-out file, empty if none
+    };
+
+  private:
+    std::string m_dir;
+    long long m_max_bytes;
+
+    std::string path(unsigned long long key);
+    void evict();
+
+  public:
+    ResultCache(const char* dir, long long max_bytes);
+
+    // 64 bit hash of len bytes, 8 at a time
+    static unsigned long long hash(const void* data, size_t len,
+                                   unsigned long long seed = 0);
+
+    // Identifies this csimple binary, so a rebuild starts a fresh cache
+    static std::string build_id();
+
+    // Fill in e and return true if key is cached
+    bool lookup(unsigned long long key, Entry& e);
+
+    // Add or replace the entry for key, then trim the cache to size
+    void store(unsigned long long key, const Entry& e);
+};
+
+#endif //CACHE_HPP
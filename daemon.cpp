@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ast.hpp"
+#include "symtab.hpp"
+#include "diagnostics.hpp"
+#include "pushparser.hpp"
+#include "resourcelimits.hpp"
+#include "daemon.hpp"
+
+// The parser (parser.ypp)
+extern bool syntax_error_exits;
+extern Program_ptr ast;
+
+// This is defined in typecheck.cpp
+class VisitProfile;
+class Incremental;
+class Xref;
+class Reachable;
+void dopass_typecheck(Program_ptr ast, SymTab* st, Diagnostics* diags,
+                      VisitProfile* profile, Incremental* incremental,
+                      Xref* xref, Reachable* reachable);
+
+static void write_fd(int fd, const char* s, size_t len)
+{
+    size_t done = 0;
+    while(done < len) {
+        ssize_t n = write(fd, s + done, len - done);
+        if(n < 0 && errno != EINTR) {
+            return;
+        }
+        done += n > 0 ? n : 0;
+    }
+}
+
+// Everything kept from one request to the next
+class Daemon
+{
+  private:
+    bool m_keep_going;
+    bool m_json;
+    SymTab m_st;
+    PushParser m_parser;
+    std::string m_in;           // Read from the client and not yet used
+    size_t m_in_pos;
+    std::string m_captured;     // stdout then stderr of the last check
+    int m_out;                  // Files that stand in for stdout and stderr
+    int m_err;                  // while a program is checked
+
+    bool fill(int in);
+    bool read_line(int in, std::string& line);
+    int check(int in, size_t len, bool& ended);
+    size_t capture(int fd);
+
+  public:
+    Daemon(bool keep_going, bool json);
+
+    // Answer requests read from in on out until in ends (true) or a quit
+    // request (false)
+    bool serve(int in, int out);
+};
+
+Daemon::Daemon(bool keep_going, bool json)
+{
+    m_keep_going = keep_going;
+    m_json = json;
+    FILE* out = tmpfile();
+    FILE* err = tmpfile();
+    if(out == NULL || err == NULL) {
+        perror("tmpfile");
+        exit(1);
+    }
+    m_out = fileno(out);
+    m_err = fileno(err);
+    m_in_pos = 0;
+    syntax_error_exits = false;
+    limit_exits = false;
+}
+
+// Wait for more from the client; false once it has nothing more to send
+bool Daemon::fill(int in)
+{
+    m_in.erase(0, m_in_pos);
+    m_in_pos = 0;
+    char buf[65536];
+    ssize_t n;
+    while((n = read(in, buf, sizeof(buf))) < 0 && errno == EINTR)
+        ;
+    if(n <= 0) {
+        return false;
+    }
+    m_in.append(buf, n);
+    return true;
+}
+
+bool Daemon::read_line(int in, std::string& line)
+{
+    size_t nl;
+    while((nl = m_in.find('\n', m_in_pos)) == std::string::npos) {
+        if(!fill(in)) {
+            return false;
+        }
+    }
+    line.assign(m_in, m_in_pos, nl - m_in_pos);
+    m_in_pos = nl + 1;
+    return true;
+}
+
+// Append what fd holds to m_captured and empty it for the next request
+size_t Daemon::capture(int fd)
+{
+    off_t len = lseek(fd, 0, SEEK_END);
+    size_t start = m_captured.size();
+    m_captured.resize(start + len);
+    size_t done = 0;
+    while(done < (size_t)len) {
+        ssize_t n = pread(fd, &m_captured[start + done], len - done, done);
+        if(n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    m_captured.resize(start + done);
+    if(ftruncate(fd, 0) < 0) {
+        perror("ftruncate");
+    }
+    lseek(fd, 0, SEEK_SET);
+    return done;
+}
+
+// Check the len bytes of program coming from in as csimple --check-only
+// would and return its exit code.  The program is parsed as it arrives.
+// Errors that would end csimple only end this check.  ended is set if in
+// ends first.  A program over --max-input-bytes is read past unparsed.
+int Daemon::check(int in, size_t len, bool& ended)
+{
+    m_parser.reset();
+    bool too_big = resource_limits.input_bytes
+        && len > resource_limits.input_bytes;
+    while(len > 0) {
+        if(m_in_pos == m_in.size() && !fill(in)) {
+            ended = true;
+            break;
+        }
+        size_t n = std::min(len, m_in.size() - m_in_pos);
+        // After a syntax error the rest is only read past
+        if(!too_big) {
+            m_parser.feed(m_in.data() + m_in_pos, n);
+        }
+        m_in_pos += n;
+        len -= n;
+    }
+
+    int status = 0;
+    if(too_big) {
+        status = limit_report(limit_input_bytes);
+    } else if(m_parser.finish() == PushParser::failed) {
+        status = limit_hit ? limit_hit : 1;
+    } else if(ast) {
+        Diagnostics diags(stderr, m_keep_going, m_json, false);
+        dopass_typecheck(ast, &m_st, &diags, NULL, NULL, NULL, NULL);
+        if(limit_hit) {
+            status = limit_hit;
+        } else if(diags.count() > 0) {
+            if(m_keep_going) {
+                diags.summary();
+            }
+            status = diags.first_code();
+        }
+    }
+    delete ast;
+    ast = NULL;
+    m_st.reset();
+    return status;
+}
+
+bool Daemon::serve(int in, int out)
+{
+    std::string line;
+    m_in.clear();
+    m_in_pos = 0;
+    while(read_line(in, line)) {
+        unsigned long len;
+        if(line == "quit") {
+            return false;
+        }
+        if(sscanf(line.c_str(), "check %lu", &len) != 1) {
+            static const char bad[] = "bad request\n";
+            write_fd(out, bad, sizeof(bad) - 1);
+            return true;
+        }
+
+        // Whatever the check prints is sent back with its status
+        fflush(stdout);
+        fflush(stderr);
+        int saved_out = dup(STDOUT_FILENO);
+        int saved_err = dup(STDERR_FILENO);
+        dup2(m_out, STDOUT_FILENO);
+        dup2(m_err, STDERR_FILENO);
+        bool ended = false;
+        int status = check(in, len, ended);
+        fflush(stdout);
+        fflush(stderr);
+        dup2(saved_out, STDOUT_FILENO);
+        dup2(saved_err, STDERR_FILENO);
+        close(saved_out);
+        close(saved_err);
+        if(ended) {
+            // The client went away part way through the program
+            return true;
+        }
+
+        m_captured.clear();
+        size_t nout = capture(m_out);
+        size_t nerr = capture(m_err);
+        char head[64];
+        int n = snprintf(head, sizeof(head), "%d %lu %lu\n", status,
+                         (unsigned long)nout, (unsigned long)nerr);
+        write_fd(out, head, n);
+        write_fd(out, m_captured.data(), m_captured.size());
+    }
+    return true;
+}
+
+int run_daemon(const char* socket_path, bool keep_going, bool json)
+{
+    Daemon daemon(keep_going, json);
+    if(socket_path == NULL) {
+        // Replies go to the real stdout, which checks borrow
+        int out = dup(STDOUT_FILENO);
+        daemon.serve(STDIN_FILENO, out);
+        close(out);
+        return 0;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", socket_path);
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path);
+    if(listener < 0 || bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0
+            || listen(listener, 16) < 0) {
+        perror(socket_path);
+        return 1;
+    }
+    // A client that goes away mid-reply must not take the daemon with it
+    signal(SIGPIPE, SIG_IGN);
+
+    bool more = true;
+    while(more) {
+        int conn = accept(listener, NULL, NULL);
+        if(conn < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+        more = daemon.serve(conn, conn);
+        close(conn);
+    }
+    close(listener);
+    unlink(socket_path);
+    return 0;
+}
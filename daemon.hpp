@@ -0,0 +1,27 @@
+#ifndef DAEMON_HPP
+#define DAEMON_HPP
+
+// csimple --daemon: check one program after another in a single process,
+// for editors and hooks that would otherwise start csimple on every save.
+// The symbol table, the program buffer and the captured output buffers are
+// kept from one request to the next.
+//
+// Requests and responses are the same on a socket and on stdin/stdout:
+//
+//     check <n>\n                  followed by the n bytes of the program
+//     <status> <nout> <nerr>\n     followed by nout bytes of stdout, then
+//                                  nerr bytes of stderr
+//
+// where status, stdout and stderr are what csimple --check-only would have
+// given for that program.  "quit" ends the daemon.
+
+// Serve requests on stdin/stdout, or if socket_path is set on a Unix socket
+// there (one connection at a time, each for as many requests as it likes).
+// keep_going and json are as for --keep-going and --diag-format=json.
+// A program over --max-input-bytes gets that limit's status without being
+// parsed; one over another limit is parsed and checked up to where csimple
+// would have exited (see limit_note) and gets that limit's status.
+// Returns csimple's exit code.
+int run_daemon(const char* socket_path, bool keep_going, bool json);
+
+#endif //DAEMON_HPP
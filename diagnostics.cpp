@@ -0,0 +1,62 @@
+#include <cstdlib>
+
+#include "diagnostics.hpp"
+#include "sourcemap.hpp"
+
+// Messages are fixed strings, but escape anything JSON needs
+static void put_json_string(FILE* f, const char* s)
+{
+    fputc('"', f);
+    for(; *s; s++) {
+        if(*s == '"' || *s == '\\') {
+            fputc('\\', f);
+            fputc(*s, f);
+        } else if((unsigned char)*s < 0x20) {
+            fprintf(f, "\\u%04x", *s);
+        } else {
+            fputc(*s, f);
+        }
+    }
+    fputc('"', f);
+}
+
+Diagnostics::Diagnostics(FILE* out, bool keep_going, bool json, bool exits)
+{
+    m_out = out;
+    m_keep_going = keep_going;
+    m_json = json;
+    m_exits = exits;
+}
+
+void Diagnostics::report(int code, unsigned int offset, const char* message)
+{
+    if(stopped()) {
+        // Only reachable without m_exits
+        return;
+    }
+    Diagnostic d = { code, offset, message };
+    m_list.push_back(d);
+
+    int line = source_map.line(offset);
+    int column = source_map.column(offset);
+    if(m_json) {
+        fprintf(m_out, "{\"line\":%d,\"column\":%d,\"code\":%d,\"message\":",
+                line, column, code);
+        put_json_string(m_out, message);
+        fprintf(m_out, "}\n");
+    } else {
+        fprintf(m_out, "on line number %d, column %d, error: %s\n", line,
+                column, message);
+    }
+
+    if(!m_keep_going && m_exits) {
+        exit(code);
+    }
+}
+
+void Diagnostics::summary()
+{
+    if(!m_json && !m_list.empty()) {
+        fprintf(m_out, "%d error%s\n", count(), count() == 1 ? "" : "s");
+    }
+}
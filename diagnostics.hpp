@@ -0,0 +1,60 @@
+#ifndef DIAGNOSTICS_HPP
+#define DIAGNOSTICS_HPP
+
+#include <cstdio>
+#include <vector>
+
+#include "resourcelimits.hpp"
+
+// One type error: the exit code csimple has always used for it, where it
+// is (Attribute::m_offset) and the message
+struct Diagnostic
+{
+    int code;
+    unsigned int offset;
+    const char* message;    // A fixed string, not owned
+};
+
+// Where Typecheck sends its errors.  By default the first error is printed
+// and csimple exits with its code, as it always has.  With keep_going every
+// error is printed and kept, and the caller decides when to stop.  Without
+// exits (csimple --daemon) the first error is still the only one printed,
+// but report returns and the rest of the program is checked silently.
+class Diagnostics
+{
+  private:
+    FILE* m_out;
+    bool m_keep_going;
+    bool m_json;            // One JSON object per line instead of text
+    bool m_exits;
+    std::vector<Diagnostic> m_list;
+
+  public:
+    Diagnostics(FILE* out, bool keep_going = false, bool json = false,
+                bool exits = true);
+
+    bool keep_going() { return m_keep_going; }
+
+    // True once a check that would have exited at its first error has had
+    // one, or has gone over a limit (see limit_note).  Whatever else the
+    // caller prints from then on is left out too.
+    bool stopped()
+    {
+        return limit_hit != 0 || (!m_keep_going && !m_list.empty());
+    }
+
+    // Print the error, with the line and column of offset in source_map,
+    // and unless keep_going or not exits, exit with code
+    void report(int code, unsigned int offset, const char* message);
+
+    int count() { return (int)m_list.size(); }
+    const std::vector<Diagnostic>& list() { return m_list; }
+
+    // Exit code of the first error, 0 if there was none
+    int first_code() { return m_list.empty() ? 0 : m_list[0].code; }
+
+    // Print the error count (text output only)
+    void summary();
+};
+
+#endif //DIAGNOSTICS_HPP
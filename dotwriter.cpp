@@ -0,0 +1,156 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "dotwriter.hpp"
+
+DotWriter::DotWriter(int fd, size_t capacity)
+{
+    m_fd = fd;
+    m_cap = capacity;
+    m_len = 0;
+    m_buf = (char*) malloc(m_cap);
+    if(m_buf == NULL) {
+        fprintf(stderr, "error: out of memory for dot output buffer\n");
+        exit(1);
+    }
+}
+
+DotWriter::DotWriter()
+{
+    m_fd = -1;
+    m_cap = 4096;
+    m_len = 0;
+    m_buf = (char*) malloc(m_cap);
+    if(m_buf == NULL) {
+        fprintf(stderr, "error: out of memory for dot output buffer\n");
+        exit(1);
+    }
+}
+
+DotWriter::~DotWriter()
+{
+    flush();
+    free(m_buf);
+}
+
+// write(2) all of buf, retrying short writes
+static void write_all(int fd, const char* buf, size_t len)
+{
+    size_t done = 0;
+    while(done < len) {
+        ssize_t n = write(fd, buf + done, len - done);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            perror("error: writing dot output");
+            exit(1);
+        }
+        done += n;
+    }
+}
+
+void DotWriter::flush()
+{
+    if(m_fd < 0) {
+        return;
+    }
+    write_all(m_fd, m_buf, m_len);
+    m_len = 0;
+}
+
+void DotWriter::grow(size_t n)
+{
+    while(m_len + n > m_cap) {
+        m_cap *= 2;
+    }
+    m_buf = (char*) realloc(m_buf, m_cap);
+    if(m_buf == NULL) {
+        fprintf(stderr, "error: out of memory for dot output buffer\n");
+        exit(1);
+    }
+}
+
+void DotWriter::append_to(DotWriter& out)
+{
+    out.put(m_buf, m_len);
+    m_len = 0;
+}
+
+void DotWriter::put(const char* s, size_t n)
+{
+    if(n > m_cap && m_fd >= 0) {
+        // Too big to buffer, so send it straight through
+        flush();
+        write_all(m_fd, s, n);
+        return;
+    }
+    reserve(n);
+    memcpy(m_buf + m_len, s, n);
+    m_len += n;
+}
+
+void DotWriter::put(const char* s)
+{
+    put(s, strlen(s));
+}
+
+void DotWriter::put_int(int x)
+{
+    // Digits come out backwards, so fill a scratch buffer from the end
+    char tmp[12];
+    char* p = tmp + sizeof(tmp);
+    unsigned int u = x < 0 ? 0u - (unsigned int) x : (unsigned int) x;
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while(u != 0);
+    if(x < 0) {
+        *--p = '-';
+    }
+    put(p, tmp + sizeof(tmp) - p);
+}
+
+void DotWriter::edge(int p, int c)
+{
+    put("\"", 1);
+    put_int(p);
+    put("\" -> \"", 6);
+    put_int(c);
+    put("\"\n", 2);
+}
+
+void DotWriter::node(int c, const char* label)
+{
+    put("\"", 1);
+    put_int(c);
+    put("\" [label=\"", 10);
+    put(label);
+    put("\"]\n", 3);
+}
+
+void DotWriter::node_int(int c, const char* label, int x)
+{
+    put("\"", 1);
+    put_int(c);
+    put("\" [label=\"", 10);
+    put(label);
+    put("\\n", 2);
+    put_int(x);
+    put("\"]\n", 3);
+}
+
+void DotWriter::node_string(int c, const char* label, const char* s)
+{
+    put("\"", 1);
+    put_int(c);
+    put("\" [label=\"", 10);
+    put(label);
+    put("\\n\\\"", 4);
+    put(s);
+    put("\\\"\"]\n", 5);
+}
@@ -0,0 +1,59 @@
+#ifndef DOTWRITER_HPP
+#define DOTWRITER_HPP
+
+#include <cstddef>
+
+// Formats dot output into a large reusable buffer and hands it to a file
+// descriptor with write(2) whenever the buffer fills up, instead of one
+// formatted stdio call per edge and node.  A writer without a file
+// descriptor keeps everything in memory for append_to.
+class DotWriter
+{
+  private:
+    int m_fd;           // Where the output goes, -1 for memory only
+    char* m_buf;
+    size_t m_len;       // Bytes currently buffered
+    size_t m_cap;
+
+    void grow(size_t n);
+    void reserve(size_t n)
+    {
+        if(m_len + n > m_cap) {
+            if(m_fd < 0) {
+                grow(n);
+            } else {
+                flush();
+            }
+        }
+    }
+
+  public:
+    DotWriter(int fd, size_t capacity = 1 << 20);
+    DotWriter();
+    ~DotWriter();
+
+    // Copy everything buffered here into out and empty this writer
+    void append_to(DotWriter& out);
+
+    // What is buffered so far
+    const char* data() const { return m_buf; }
+    size_t size() const { return m_len; }
+
+    void put(const char* s);
+    void put(const char* s, size_t n);
+    void put_int(int x);
+
+    // "p" -> "c"
+    void edge(int p, int c);
+    // "c" [label="label"]
+    void node(int c, const char* label);
+    // "c" [label="label\n<x>"]
+    void node_int(int c, const char* label, int x);
+    // "c" [label="label\n\"<s>\""]
+    void node_string(int c, const char* label, const char* s);
+
+    // Write out everything buffered so far (no-op for memory writers)
+    void flush();
+};
+
+#endif //DOTWRITER_HPP
@@ -0,0 +1,95 @@
+#include <atomic>
+#include <ctime>
+
+#include <unistd.h>
+
+#include "eventtrace.hpp"
+
+EventTrace* event_trace = NULL;
+
+static double clock_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+// Small, stable thread numbers read better in the viewer than pthread ids
+static int thread_number()
+{
+    static std::atomic<int> next(1);
+    static thread_local int mine = 0;
+    if(mine == 0) {
+        mine = next++;
+    }
+    return mine;
+}
+
+// Names are identifiers or fixed labels, but escape anything JSON needs
+static void put_json_string(FILE* f, const char* s)
+{
+    fputc('"', f);
+    for(; *s; s++) {
+        if(*s == '"' || *s == '\\') {
+            fputc('\\', f);
+            fputc(*s, f);
+        } else if((unsigned char)*s < 0x20) {
+            fprintf(f, "\\u%04x", *s);
+        } else {
+            fputc(*s, f);
+        }
+    }
+    fputc('"', f);
+}
+
+EventTrace::EventTrace(FILE* out)
+{
+    m_out = out;
+    m_first = true;
+    m_t0 = clock_us();
+    fprintf(m_out, "{\"traceEvents\":[\n");
+}
+
+double EventTrace::now()
+{
+    return clock_us() - m_t0;
+}
+
+void EventTrace::span(const char* cat, const char* name, double start,
+                      long nodes, long scopes)
+{
+    double end = now();
+    int tid = thread_number();
+
+    std::lock_guard<std::mutex> hold(m_lock);
+    if(m_out == NULL) {
+        return;
+    }
+    fprintf(m_out, "%s{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+            "\"cat\":", m_first ? "" : ",\n", (int)getpid(), tid, start, end - start);
+    put_json_string(m_out, cat);
+    fprintf(m_out, ",\"name\":");
+    put_json_string(m_out, name);
+    fprintf(m_out, ",\"args\":{");
+    const char* sep = "";
+    if(nodes >= 0) {
+        fprintf(m_out, "\"nodes\":%ld", nodes);
+        sep = ",";
+    }
+    if(scopes >= 0) {
+        fprintf(m_out, "%s\"scopes\":%ld", sep, scopes);
+    }
+    fprintf(m_out, "}}");
+    m_first = false;
+}
+
+void EventTrace::close()
+{
+    std::lock_guard<std::mutex> hold(m_lock);
+    if(m_out == NULL) {
+        return;
+    }
+    fprintf(m_out, "\n]}\n");
+    fclose(m_out);
+    m_out = NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef EVENTTRACE_HPP
+#define EVENTTRACE_HPP
+
+#include <cstdio>
+#include <mutex>
+
+// Writes Chrome / Perfetto trace-event JSON ("complete" X events) for
+// csimple --trace-events: a span per phase and per procedure checked or
+// drawn.  Safe to use from the --dot-jobs worker threads.
+class EventTrace
+{
+  private:
+    FILE* m_out;
+    std::mutex m_lock;
+    bool m_first;       // No event written yet
+    double m_t0;        // Clock at creation, so timestamps start near 0
+
+  public:
+    EventTrace(FILE* out);
+
+    // Microseconds since the trace was created
+    double now();
+
+    // Record a span from start (a value of now()) until now.  nodes and
+    // scopes are added as arguments unless negative.
+    void span(const char* cat, const char* name, double start,
+              long nodes = -1, long scopes = -1);
+
+    // Finish the JSON and close the file
+    void close();
+};
+
+// The trace for this run, NULL unless --trace-events was given
+extern EventTrace* event_trace;
+
+#endif //EVENTTRACE_HPP
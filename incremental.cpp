@@ -0,0 +1,232 @@
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "incremental.hpp"
+#include "symtab.hpp"
+#include "primitive.hpp"
+#include "cache.hpp"
+
+// Bumped whenever the file layout or the fingerprints change
+static const int incremental_version = 2;
+
+// Hash of a subtree: the kind of each node and the names and literals at
+// its leaves, but not where it sits in the tree or the source
+class Fingerprint : public PreorderWalk<Fingerprint>
+{
+  private:
+    void mix(const void* data, size_t len)
+    {
+        m_hash = ResultCache::hash(data, len, m_hash);
+    }
+
+    void mix_string(const char* s)
+    {
+        size_t len = strlen(s);
+        mix(&len, sizeof(len));
+        mix(s, len);
+    }
+
+  public:
+    unsigned long long m_hash;
+
+    Fingerprint() { m_hash = 0; }
+
+    void node(int kind) { mix(&kind, sizeof(kind)); }
+
+    void visitSymName(SymName* p)
+    {
+        node(ast_kind_SymName);
+        mix_string(p->spelling());
+    }
+
+    void visitPrimitive(Primitive* p)
+    {
+        node(ast_kind_Primitive);
+        mix(&p->m_data, sizeof(p->m_data));
+    }
+
+    void visitStringPrimitive(StringPrimitive* p)
+    {
+        node(ast_kind_StringPrimitive);
+        mix_string(p->m_string);
+    }
+};
+
+template<class T>
+static unsigned long long fingerprint(T* p)
+{
+    Fingerprint f;
+    f.visit(p);
+    return f.m_hash;
+}
+
+// Name, parameters and return type, which is all a caller can see
+static unsigned long long signature(ProcImpl* p)
+{
+    std::vector<unsigned long long> parts;
+    parts.push_back(fingerprint(p->m_type));
+    for(std::list<Decl_ptr>::iterator i = p->m_decl_list->begin();
+            i != p->m_decl_list->end(); ++i) {
+        parts.push_back(fingerprint(*i));
+    }
+    const char* name = p->m_symname->spelling();
+    return ResultCache::hash(parts.data(), parts.size() * sizeof(parts[0]),
+                             ResultCache::hash(name, strlen(name)));
+}
+
+Incremental::Incremental(const char* path)
+{
+    m_path = path;
+    m_skipped = 0;
+
+    FILE* f = fopen(path, "r");
+    if(f == NULL) {
+        return;     // First run
+    }
+    char id[256];
+    int version;
+    if(fscanf(f, "csimple-incremental %d %255s", &version, id) != 2
+            || version != incremental_version
+            || ResultCache::build_id() != id) {
+        // Another csimple may check differently, so start over
+        fclose(f);
+        return;
+    }
+
+    char name[1024];
+    unsigned long long body, sig;
+    int nuses;
+    while(fscanf(f, " proc %1023s %llx %llx %d", name, &body, &sig, &nuses) == 4) {
+        ProcState& s = m_old[name];
+        s.body = body;
+        s.sig = sig;
+        for(int i = 0; i < nuses; i++) {
+            if(fscanf(f, " use %1023s %llx", name, &sig) != 2) {
+                // Truncated; trust nothing
+                m_old.clear();
+                fclose(f);
+                return;
+            }
+            s.uses.push_back(std::make_pair(std::string(name), sig));
+        }
+    }
+    fclose(f);
+}
+
+void Incremental::plan(ProgramImpl* prog)
+{
+    // Signature of each procedure defined so far, the first of any name
+    std::map<std::string, unsigned long long> before;
+
+    for(std::list<Proc_ptr>::iterator i = prog->m_proc_list->begin();
+            i != prog->m_proc_list->end(); ++i) {
+        ProcImpl* p = dynamic_cast<ProcImpl*>(*i);
+        if(p == NULL) {
+            continue;
+        }
+        Current c;
+        c.name = p->m_symname->spelling();
+        c.state.body = fingerprint(p);
+        c.state.sig = signature(p);
+        c.skipped = false;
+        c.clean = false;
+
+        std::map<std::string, ProcState>::iterator old = m_old.find(c.name);
+        // A second definition must be checked to be reported
+        if(old != m_old.end() && before.count(c.name) == 0
+                && old->second.body == c.state.body) {
+            c.skipped = true;
+            std::vector<std::pair<std::string, unsigned long long> >& uses =
+                old->second.uses;
+            for(size_t u = 0; u < uses.size(); u++) {
+                if(uses[u].first == c.name) {
+                    continue;   // Recursion; our own signature is unchanged
+                }
+                std::map<std::string, unsigned long long>::iterator b =
+                    before.find(uses[u].first);
+                if(b == before.end() || b->second != uses[u].second) {
+                    c.skipped = false;
+                    break;
+                }
+            }
+        }
+        if(c.skipped) {
+            c.state.uses = old->second.uses;
+            c.clean = true;
+            m_skipped++;
+        }
+
+        if(before.count(c.name) == 0) {
+            before[c.name] = c.state.sig;
+        }
+        m_index[p] = m_procs.size();
+        m_procs.push_back(c);
+    }
+}
+
+bool Incremental::skip(ProcImpl* p)
+{
+    std::map<ProcImpl*, size_t>::iterator i = m_index.find(p);
+    return i != m_index.end() && m_procs[i->second].skipped;
+}
+
+void Incremental::used(ProcImpl* p, const char* name)
+{
+    std::map<ProcImpl*, size_t>::iterator i = m_index.find(p);
+    if(i != m_index.end()) {
+        m_procs[i->second].used.insert(name);
+    }
+}
+
+void Incremental::done(ProcImpl* p, bool clean)
+{
+    std::map<ProcImpl*, size_t>::iterator i = m_index.find(p);
+    if(i == m_index.end()) {
+        return;
+    }
+    Current& c = m_procs[i->second];
+    c.clean = clean;
+    c.state.uses.clear();
+    for(std::set<std::string>::iterator u = c.used.begin();
+            u != c.used.end(); ++u) {
+        // Whatever was used resolved to an earlier (or this) definition
+        for(size_t j = 0; j <= i->second; j++) {
+            if(m_procs[j].name == *u) {
+                c.state.uses.push_back(std::make_pair(*u, m_procs[j].state.sig));
+                break;
+            }
+        }
+    }
+}
+
+void Incremental::save()
+{
+    char tmp[32];
+    snprintf(tmp, sizeof(tmp), ".tmp.%d", (int)getpid());
+    std::string tmp_path = m_path + tmp;
+    FILE* f = fopen(tmp_path.c_str(), "w");
+    if(f == NULL) {
+        perror(tmp_path.c_str());
+        return;
+    }
+    fprintf(f, "csimple-incremental %d %s\n", incremental_version,
+            ResultCache::build_id().c_str());
+    for(size_t i = 0; i < m_procs.size(); i++) {
+        Current& c = m_procs[i];
+        if(!c.clean) {
+            continue;   // Only clean results are reused
+        }
+        fprintf(f, "proc %s %016llx %016llx %d\n", c.name.c_str(),
+                c.state.body, c.state.sig, (int)c.state.uses.size());
+        for(size_t u = 0; u < c.state.uses.size(); u++) {
+            fprintf(f, "use %s %016llx\n", c.state.uses[u].first.c_str(),
+                    c.state.uses[u].second);
+        }
+    }
+    if(fclose(f) != 0 || rename(tmp_path.c_str(), m_path.c_str()) != 0) {
+        perror(m_path.c_str());
+        unlink(tmp_path.c_str());
+    }
+}
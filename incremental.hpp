@@ -0,0 +1,71 @@
+#ifndef INCREMENTAL_HPP
+#define INCREMENTAL_HPP
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "ast.hpp"
+
+// Incremental re-checking for --incremental=FILE.  Each top level
+// procedure is fingerprinted twice: its whole subtree (the tokens of its
+// definition, ignoring layout and comments) and its signature (name,
+// parameters and return type).  FILE remembers, for every procedure that
+// checked cleanly, both fingerprints and the signature of every global
+// procedure it used.  On the next run a procedure is only checked again if
+// its own fingerprint changed, or a procedure it used now has a different
+// signature or is no longer defined before it.  Skipped procedures are
+// still entered into the global scope, so everything after them sees the
+// same symbols as a full check.
+class Incremental
+{
+  private:
+    struct ProcState
+    {
+        unsigned long long body;
+        unsigned long long sig;
+        // Global procedures used and their signatures when this was checked
+        std::vector<std::pair<std::string, unsigned long long> > uses;
+    };
+
+    std::string m_path;
+    std::map<std::string, ProcState> m_old;     // Clean procedures from FILE
+
+    // This run, by top level procedure
+    struct Current
+    {
+        std::string name;
+        ProcState state;
+        bool skipped;
+        bool clean;
+        std::set<std::string> used;
+    };
+    std::vector<Current> m_procs;
+    std::map<ProcImpl*, size_t> m_index;
+    int m_skipped;
+
+  public:
+    // Loads FILE if it exists and was written by this csimple binary
+    Incremental(const char* path);
+
+    // Fingerprint the procedures of prog and decide which can be skipped
+    void plan(ProgramImpl* prog);
+
+    // True if the top level procedure p is unchanged and need not be checked
+    bool skip(ProcImpl* p);
+
+    // Checking top level procedure p used the global procedure name
+    void used(ProcImpl* p, const char* name);
+
+    // Checking top level procedure p has finished
+    void done(ProcImpl* p, bool clean);
+
+    // Write the state for the next run to FILE
+    void save();
+
+    int skipped() { return m_skipped; }
+    int total() { return (int)m_procs.size(); }
+};
+
+#endif //INCREMENTAL_HPP
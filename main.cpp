@@ -9,29 +9,590 @@
 #include "parser.hpp"
 #include "symtab.hpp"
 #include "primitive.hpp"
+#include "passtimer.hpp"
+#include "eventtrace.hpp"
+#include "visitprofile.hpp"
+#include "stats.hpp"
+#include "diagnostics.hpp"
+#include "cache.hpp"
+#include "incremental.hpp"
+#include "daemon.hpp"
+#include "astbin.hpp"
+#include "xref.hpp"
+#include "reachable.hpp"
+#include "resourcelimits.hpp"
+#include "passmanager.hpp"
+#include "dotwriter.hpp"
+#include "pushparser.hpp"
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
 
+extern FILE* yyin;
 extern int yydebug;
 extern int yyparse();
+extern int yylex();
 
-// This is defined in ast2dot.cpp
-void dopass_ast2dot(Program_ptr ast);
+// dopass_ast2dot is defined in ast2dot.cpp
+#include "ast2dot.hpp"
 
 // This is defined in typecheck.cpp
-void dopass_typecheck(Program_ptr ast, SymTab* st);
+void dopass_typecheck(Program_ptr ast, SymTab* st, Diagnostics* diags,
+                      VisitProfile* profile, Incremental* incremental,
+                      Xref* xref, Reachable* reachable);
+FusedPass* fused_typecheck(Program_ptr ast, SymTab* st, Diagnostics* diags,
+                           Incremental* incremental, Xref* xref,
+                           Reachable* reachable);
 
 // Make sure to set this to the final // syntax tree in parser.ypp
 Program_ptr ast;
-int main(void)
+
+// Per-phase measurements, reported at exit so that runs stopped by a type
+// error are covered too
+static PassTimer passes;
+static bool time_passes = false;
+static bool mem_report = false;
+static bool perf_counters = false;
+static VisitProfile* typecheck_profile = NULL;  // Set by --profile-visits
+static VisitProfile* ast2dot_profile = NULL;
+static bool stats = false;
+// Symbol table for --stats.  Only set while a type error could still exit,
+// which does not unwind main, so it stays valid in finish_passes.
+static SymTab* stats_symtab = NULL;
+// Saved at exit, so that procedures which did check cleanly are remembered
+// even when another one stops the run
+static Incremental* incremental = NULL;
+// For --reachable-only, whose count is reported at exit for the same reason
+static Reachable* reachable = NULL;
+
+static void finish_passes()
+{
+    passes.stop();
+    if(time_passes || mem_report) {
+        passes.report(stderr, time_passes, mem_report);
+    }
+    if(stats_symtab) {
+        print_stats(stderr, ast, stats_symtab);
+    }
+    if(incremental) {
+        incremental->save();
+        if(stats) {
+            fprintf(stderr, "incremental: %d of %d procedures skipped\n",
+                    incremental->skipped(), incremental->total());
+        }
+    }
+    if(reachable) {
+        fprintf(stderr, "reachable-only: %d of %d procedures not reachable "
+                "from Main, skipped\n", reachable->skipped(), reachable->total());
+    }
+    if(typecheck_profile) {
+        typecheck_profile->print(stderr, "typecheck");
+    }
+    if(ast2dot_profile) {
+        ast2dot_profile->print(stderr, "ast2dot");
+    }
+    if(event_trace) {
+        event_trace->close();
+    }
+}
+
+// Read all of f from the start
+static std::string slurp(FILE* f)
+{
+    std::string s;
+    char buf[65536];
+    size_t n;
+    fflush(f);
+    rewind(f);
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        s.append(buf, n);
+    }
+    return s;
+}
+
+static void write_fd(int fd, const std::string& s)
+{
+    size_t done = 0;
+    while(done < s.size()) {
+        ssize_t n = write(fd, s.data() + done, s.size() - done);
+        if(n < 0 && errno != EINTR) {
+            return;
+        }
+        done += n > 0 ? n : 0;
+    }
+}
+
+// Copy the dot graph a DotWriter wrote to the file f into out
+static void unspill(FILE* f, DotWriter& out)
+{
+    char buf[65536];
+    size_t n;
+    rewind(f);      // The writer bypassed stdio, so this is all lseek does
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        out.put(buf, n);
+    }
+    if(ferror(f)) {
+        perror("error: reading dot output");
+        exit(1);
+    }
+}
+
+// The program text, read up front for --cache-dir
+static std::string input;
+
+// For --cache-dir: exit with the cached result for this input and options
+// if there is one.  Otherwise fork; the child returns and runs the check
+// with its output captured, and the parent stores the child's result and
+// passes it on.  The program is read from stdin first, since its hash is
+// the key, and the child parses that copy.  dot_out is the file a clean
+// run writes its graph to, or NULL; runs that fail never touch it.
+static void run_cached(const char* dir, long long max_bytes,
+                       const std::string& options, const char* dot_out)
+{
+    char buf[65536];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), stdin)) > 0) {
+        input.append(buf, n);
+        if(resource_limits.input_bytes
+                && input.size() > resource_limits.input_bytes) {
+            limit_exceeded(limit_input_bytes);
+        }
+    }
+    // An empty buffer cannot be fmemopen'd
+    yyin = input.empty() ? fopen("/dev/null", "r")
+                         : fmemopen(&input[0], input.size(), "r");
+
+    ResultCache cache(dir, max_bytes);
+    std::string salt = ResultCache::build_id() + "\n" + options;
+    unsigned long long key = ResultCache::hash(input.data(), input.size(),
+                                ResultCache::hash(salt.data(), salt.size()));
+    ResultCache::Entry e;
+    if(cache.lookup(key, e)) {
+        if(dot_out && e.status == 0) {
+            int fd = open(dot_out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if(fd < 0) {
+                perror(dot_out);
+                exit(1);
+            }
+            write_fd(fd, e.dot);
+            close(fd);
+        }
+        write_fd(STDOUT_FILENO, e.out);
+        write_fd(STDERR_FILENO, e.err);
+        exit(e.status);
+    }
+
+    FILE* out = tmpfile();
+    FILE* err = tmpfile();
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = out && err ? fork() : -1;
+    if(pid <= 0) {
+        if(pid == 0) {
+            dup2(fileno(out), STDOUT_FILENO);
+            dup2(fileno(err), STDERR_FILENO);
+        }
+        return;     // The child, or no cache after all
+    }
+
+    int status;
+    while(waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    e.out = slurp(out);
+    e.err = slurp(err);
+    write_fd(STDOUT_FILENO, e.out);
+    write_fd(STDERR_FILENO, e.err);
+    if(!WIFEXITED(status)) {
+        // Crashes are not cached
+        signal(WTERMSIG(status), SIG_DFL);
+        raise(WTERMSIG(status));
+        exit(1);
+    }
+    e.status = WEXITSTATUS(status);
+    if(dot_out && e.status == 0) {
+        FILE* f = fopen(dot_out, "r");
+        if(f == NULL) {
+            exit(e.status);
+        }
+        e.dot = slurp(f);
+        fclose(f);
+    }
+    cache.store(key, e);
+    exit(e.status);
+}
+
+// For --push-bytes: parse stdin the way csimple --daemon does, handed to a
+// PushParser n bytes at a time, so that every split the daemon could meet
+// can be checked against yyparse.  A syntax error exits, as from yyparse.
+static void push_parse(size_t n)
 {
+    FILE* in = yyin ? yyin : stdin;
+    std::vector<char> buf(n);
+    PushParser parser;
+    size_t len;
+    while((len = fread(&buf[0], 1, n, in)) > 0) {
+        limit_input(len);
+        parser.feed(&buf[0], len);
+    }
+    parser.finish();
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: csimple [--check-only | --dot-out=FILE] "
+                    "[--dot-jobs=N] [--symtab-trace=FILE]\n"
+                    "               [--dot-max-depth=N] [--dot-max-nodes=N] "
+                    "[--dot-procs=NAME,...]\n"
+                    "               [--stop-after=lex|parse|typecheck] "
+                    "[--time-passes] [--mem-report]\n"
+                    "               [--perf-counters] [--trace-events=FILE] "
+                    "[--profile-visits] [--stats]\n"
+                    "               [--keep-going] [--diag-format=text|json] "
+                    "[--reachable-only] [--fuse-passes]\n"
+                    "               [--cache-dir=DIR] [--cache-max-mb=N] "
+                    "[--incremental=FILE]\n"
+                    "               [--ast-out=FILE] [--xref-out=FILE] "
+                    "[--push-bytes=N]\n"
+                    "               [--max-input-bytes=N] [--max-nodes=N] "
+                    "[--max-depth=N]\n"
+                    "               [--max-scopes=N] [--max-ast-bytes=N] < program\n"
+                    "       csimple --ast-in=FILE [options]\n"
+                    "       csimple --xref-in=FILE "
+                    "(--xref-uses=NAME | --xref-at=LINE)\n"
+                    "       csimple --daemon[=SOCKET] [--keep-going] "
+                    "[--diag-format=text|json]\n"
+                    "                              [--max-input-bytes=N] "
+                    "[--max-nodes=N] [--max-depth=N]\n"
+                    "                              [--max-scopes=N] "
+                    "[--max-ast-bytes=N]\n");
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    const char* symtab_trace = NULL;    // Where to log symbol table ops
+    const char* dot_out = NULL;         // Dot file instead of stdout
+    bool check_only = false;            // Only typecheck, no dot output
+    const char* stop_after = NULL;      // Last phase to run (for benchmarks)
+    int dot_jobs = 1;                   // Threads drawing the dot graph
+    DotLimits limits;                   // How much of the graph to draw
+    bool keep_going = false;            // Report every type error
+    bool reachable_only = false;        // Skip what Main cannot call
+    bool fuse_passes = false;           // One walk for every pass
+    bool diag_json = false;             // Type errors as JSON lines
+    const char* cache_dir = getenv("CSIMPLE_CACHE_DIR");
+    long long cache_max_mb = 256;       // Cache size cap
+    const char* incremental_path = NULL; // State kept between runs
+    bool daemon = false;                // Serve check requests
+    const char* daemon_socket = NULL;   // On this socket, else stdin/stdout
+    const char* ast_out = NULL;         // Binary AST of a checked program
+    const char* ast_in = NULL;          // Load that instead of parsing
+    int push_bytes = 0;                 // Push parse stdin in pieces this big
+    const char* xref_out = NULL;        // Cross-reference index
+    const char* xref_in = NULL;         // Query this index
+    const char* xref_uses = NULL;       // for the definition and uses of a name
+    int xref_at = 0;                    // or for what is on a line
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--check-only")) {
+            check_only = true;
+        } else if(!strcmp(argv[i], "--time-passes")) {
+            time_passes = true;
+        } else if(!strcmp(argv[i], "--mem-report")) {
+            mem_report = true;
+        } else if(!strcmp(argv[i], "--perf-counters")) {
+            perf_counters = true;
+        } else if(!strcmp(argv[i], "--keep-going")) {
+            keep_going = true;
+        } else if(!strcmp(argv[i], "--reachable-only")) {
+            reachable_only = true;
+        } else if(!strcmp(argv[i], "--fuse-passes")) {
+            fuse_passes = true;
+        } else if(!strncmp(argv[i], "--diag-format=", 14)) {
+            if(!strcmp(argv[i] + 14, "json")) {
+                diag_json = true;
+            } else if(strcmp(argv[i] + 14, "text")) {
+                usage();
+            }
+        } else if(!strncmp(argv[i], "--cache-dir=", 12)) {
+            cache_dir = argv[i] + 12;
+        } else if(!strncmp(argv[i], "--cache-max-mb=", 15)) {
+            cache_max_mb = atoll(argv[i] + 15);
+        } else if(!strcmp(argv[i], "--daemon")) {
+            daemon = true;
+        } else if(!strncmp(argv[i], "--daemon=", 9)) {
+            daemon = true;
+            daemon_socket = argv[i] + 9;
+        } else if(!strncmp(argv[i], "--incremental=", 14)) {
+            incremental_path = argv[i] + 14;
+        } else if(!strncmp(argv[i], "--ast-out=", 10)) {
+            ast_out = argv[i] + 10;
+        } else if(!strncmp(argv[i], "--ast-in=", 9)) {
+            ast_in = argv[i] + 9;
+        } else if(!strncmp(argv[i], "--push-bytes=", 13)) {
+            push_bytes = atoi(argv[i] + 13);
+            if(push_bytes < 1) {
+                usage();
+            }
+        } else if(!strncmp(argv[i], "--xref-out=", 11)) {
+            xref_out = argv[i] + 11;
+        } else if(!strncmp(argv[i], "--xref-in=", 10)) {
+            xref_in = argv[i] + 10;
+        } else if(!strncmp(argv[i], "--xref-uses=", 12)) {
+            xref_uses = argv[i] + 12;
+        } else if(!strncmp(argv[i], "--xref-at=", 10)) {
+            xref_at = atoi(argv[i] + 10);
+            if(xref_at < 1) {
+                usage();
+            }
+        } else if(!strncmp(argv[i], "--max-input-bytes=", 18)) {
+            resource_limits.input_bytes = strtoul(argv[i] + 18, NULL, 10);
+        } else if(!strncmp(argv[i], "--max-nodes=", 12)) {
+            resource_limits.nodes = strtoul(argv[i] + 12, NULL, 10);
+        } else if(!strncmp(argv[i], "--max-depth=", 12)) {
+            unsigned long depth = strtoul(argv[i] + 12, NULL, 10);
+            resource_limits.depth = depth == 0 || depth > Attribute::max_depth
+                                  ? Attribute::max_depth : depth;
+        } else if(!strncmp(argv[i], "--max-scopes=", 13)) {
+            resource_limits.scopes = strtoul(argv[i] + 13, NULL, 10);
+        } else if(!strncmp(argv[i], "--max-ast-bytes=", 16)) {
+            resource_limits.ast_bytes = strtoul(argv[i] + 16, NULL, 10);
+        } else if(!strcmp(argv[i], "--stats")) {
+            stats = true;
+        } else if(!strcmp(argv[i], "--profile-visits")) {
+            typecheck_profile = new VisitProfile();
+            ast2dot_profile = new VisitProfile();
+        } else if(!strncmp(argv[i], "--trace-events=", 15)) {
+            FILE* f = fopen(argv[i] + 15, "w");
+            if(!f) {
+                perror(argv[i] + 15);
+                exit(1);
+            }
+            event_trace = new EventTrace(f);
+        } else if(!strncmp(argv[i], "--dot-out=", 10)) {
+            dot_out = argv[i] + 10;
+        } else if(!strncmp(argv[i], "--stop-after=", 13)) {
+            stop_after = argv[i] + 13;
+            if(!strcmp(stop_after, "typecheck")) {
+                check_only = true;
+            } else if(strcmp(stop_after, "lex") && strcmp(stop_after, "parse")) {
+                usage();
+            }
+        } else if(!strncmp(argv[i], "--dot-jobs=", 11)) {
+            dot_jobs = atoi(argv[i] + 11);
+            if(dot_jobs < 1) {
+                usage();
+            }
+        } else if(!strncmp(argv[i], "--dot-max-depth=", 16)) {
+            limits.max_depth = atoi(argv[i] + 16);
+        } else if(!strncmp(argv[i], "--dot-max-nodes=", 16)) {
+            limits.max_nodes = atoi(argv[i] + 16);
+        } else if(!strncmp(argv[i], "--dot-procs=", 12)) {
+            char* names = strdup(argv[i] + 12);
+            for(char* n = strtok(names, ","); n; n = strtok(NULL, ",")) {
+                limits.procs.insert(n);
+            }
+            free(names);
+        } else if(!strncmp(argv[i], "--symtab-trace=", 15)) {
+            symtab_trace = argv[i] + 15;
+        } else {
+            usage();
+        }
+    }
+
+    if(daemon) {
+        return run_daemon(daemon_socket, keep_going, diag_json);
+    }
+    if(xref_in) {
+        if(!xref_uses == !xref_at) {
+            usage();
+        }
+        XrefFile index(xref_in);
+        std::vector<XrefFile::Ref> refs;
+        if(xref_uses) {
+            index.uses(xref_uses, refs);
+        } else {
+            index.at(xref_at, refs);
+        }
+        XrefFile::print(stdout, refs);
+        return refs.empty();
+    }
+
+    // Reports about the run itself describe this process, so they are
+    // never served from the cache; nor are runs that must update their
+    // --incremental state, nor runs that read or write a binary AST, nor
+    // --push-bytes runs, which are there to exercise the parser
+    bool observed = time_passes || mem_report || perf_counters || event_trace
+        || stats || typecheck_profile || symtab_trace || stop_after
+        || incremental_path || ast_out || ast_in || xref_out || push_bytes;
+    if(cache_dir && *cache_dir && !observed) {
+        // Everything that changes what a run writes is part of the key
+        std::string options = std::string("check_only=") + (check_only ? "1" : "0")
+            + " keep_going=" + (keep_going ? "1" : "0")
+            + " reachable_only=" + (reachable_only ? "1" : "0")
+            + " json=" + (diag_json ? "1" : "0")
+            + " dot_out=" + (dot_out ? "1" : "0")
+            + " max_depth=" + std::to_string(limits.max_depth)
+            + " max_nodes=" + std::to_string(limits.max_nodes)
+            + " max_input_bytes=" + std::to_string(resource_limits.input_bytes)
+            + " max_nodes=" + std::to_string(resource_limits.nodes)
+            + " max_depth=" + std::to_string(resource_limits.depth)
+            + " max_scopes=" + std::to_string(resource_limits.scopes)
+            + " max_ast_bytes=" + std::to_string(resource_limits.ast_bytes)
+            + " procs=";
+        for(std::set<std::string>::iterator p = limits.procs.begin();
+                p != limits.procs.end(); ++p) {
+            options += *p + ",";
+        }
+        run_cached(cache_dir, cache_max_mb << 20, options,
+                   check_only ? NULL : dot_out);
+    }
+
+    if(perf_counters) {
+        // Counters are shown next to the phase timings; if they cannot be
+        // opened the report says why and the run carries on
+        time_passes = true;
+        passes.enable_perf();
+    }
+    // At exit, so that runs stopped by a type error are covered too
+    atexit(finish_passes);
+
+    if(ast_in && ((stop_after && strcmp(stop_after, "typecheck"))
+                  || push_bytes)) {
+        usage();    // Nothing is scanned or parsed
+    }
+    if(stop_after && !strcmp(stop_after, "lex")) {
+        passes.start("lex");
+        while(yylex() != 0)
+            ;
+        return 0;
+    }
+
     yydebug = 0;    // Set yydebug to 1 if you want yyparse() to dump a trace
-    yyparse();
+    if(ast_in) {
+        passes.start("load");
+        ast = ast_bin_read(ast_in);
+    } else if(push_bytes) {
+        passes.start("parse");
+        push_parse(push_bytes);
+    } else {
+        passes.start("parse");
+        yyparse();
+    }
+    passes.stop();
+    if(stop_after && !strcmp(stop_after, "parse")) {
+        return 0;
+    }
 
     SymTab st;      // Symbol Table
+    FILE* trace = NULL;
+    if(symtab_trace) {
+        trace = fopen(symtab_trace, "w");
+        if(!trace) {
+            perror(symtab_trace);
+            exit(1);
+        }
+        st.set_trace(trace);
+    }
     if(ast) {       // Walk over the ast and print it out as a dot file
-        dopass_typecheck(ast, &st);
-        dopass_ast2dot(ast);
+        // Fused, typecheck, dot and --stats take each procedure in turn.
+        // The visit profile times each pass on its own walk, and the dot
+        // graph is drawn in parallel only on its own.
+        bool fused = fuse_passes && !typecheck_profile && dot_jobs == 1;
+        passes.start(fused ? "fused" : "typecheck");
+        if(stats) {
+            stats_symtab = &st;
+        }
+        Diagnostics diags(stderr, keep_going, diag_json);
+        if(incremental_path) {
+            incremental = new Incremental(incremental_path);
+        }
+        if(reachable_only) {
+            reachable = new Reachable();
+        }
+        Xref* xref = xref_out ? new Xref() : NULL;
+        AstShape shape;
+        // Drawn fused, the graph is only written once the program checks.
+        // Until then it waits in a temporary file, not in memory, where it
+        // would take as much again as the tree; without a temporary file
+        // it is kept in memory after all.
+        FILE* spill = fused && !check_only ? tmpfile() : NULL;
+        DotWriter dot(spill ? fileno(spill) : -1);
+        if(fused) {
+            PassManager manager;
+            manager.add(fused_typecheck(ast, &st, &diags, incremental, xref,
+                                        reachable));
+            if(!check_only) {
+                manager.add(fused_ast2dot(&dot, &limits));
+            }
+            if(stats) {
+                manager.add(fused_shape(&shape));
+            }
+            manager.run(ast);
+        } else {
+            dopass_typecheck(ast, &st, &diags, typecheck_profile, incremental,
+                             xref, reachable);
+        }
+        passes.stop();
+        // With --keep-going the index is written even if there are errors
+        if(xref && !xref->write(xref_out)) {
+            exit(1);
+        }
+        delete xref;
+        if(stats) {
+            print_stats(stderr, ast, &st, fused ? &shape : NULL);
+            stats_symtab = NULL;
+        }
+        if(diags.count() > 0) {
+            // Same exit code as stopping at the first error
+            diags.summary();
+            exit(diags.first_code());
+        }
+        if(ast_out && !ast_bin_write(ast, ast_out)) {
+            exit(1);
+        }
+        if(!check_only) {
+            int fd = STDOUT_FILENO;
+            if(dot_out) {
+                fd = open(dot_out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if(fd < 0) {
+                    perror(dot_out);
+                    exit(1);
+                }
+            }
+            fflush(stdout);     // The dot writer bypasses stdio
+            passes.start("ast2dot");
+            if(fused) {
+                DotWriter out(fd);
+                if(spill) {
+                    dot.flush();
+                    unspill(spill, out);
+                } else {
+                    dot.append_to(out);
+                }
+                out.flush();
+            } else if(dot_jobs > 1 && !ast2dot_profile) {
+                dopass_ast2dot_parallel(ast, fd, dot_jobs, &limits);
+            } else {
+                // The visit profile is single threaded
+                dopass_ast2dot(ast, fd, &limits, ast2dot_profile);
+            }
+            passes.stop();
+            if(dot_out) {
+                close(fd);
+            }
+        }
     }
 
+    if(trace) {
+        fclose(trace);
+    }
     return 0;
 }
@@ -0,0 +1,41 @@
+#include <cassert>
+
+#include "passmanager.hpp"
+
+PassManager::~PassManager()
+{
+    for(size_t i = 0; i < m_passes.size(); i++) {
+        delete m_passes[i];
+    }
+}
+
+void PassManager::add(FusedPass* pass)
+{
+    m_passes.push_back(pass);
+    if(pass->order() & FusedPass::pre_order) {
+        m_pre.push_back(pass);
+    }
+    if(pass->order() & FusedPass::post_order) {
+        m_post.push_back(pass);
+    }
+}
+
+void PassManager::run(Program_ptr ast)
+{
+    ProgramImpl* prog = dynamic_cast<ProgramImpl*>(ast);
+    assert(prog != NULL);
+    for(size_t i = 0; i < m_pre.size(); i++) {
+        m_pre[i]->program(prog, FusedPass::pre_order);
+    }
+    for(std::list<Proc_ptr>::iterator p = prog->m_proc_list->begin();
+            p != prog->m_proc_list->end(); ++p) {
+        ProcImpl* proc = dynamic_cast<ProcImpl*>(*p);
+        assert(proc != NULL);
+        for(size_t i = 0; i < m_passes.size(); i++) {
+            m_passes[i]->proc(proc);
+        }
+    }
+    for(size_t i = 0; i < m_post.size(); i++) {
+        m_post[i]->program(prog, FusedPass::post_order);
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef PASSMANAGER_HPP
+#define PASSMANAGER_HPP
+
+#include <vector>
+
+#include "ast.hpp"
+
+// A pass that can share one walk over the program with others (see
+// PassManager).  It is handed each top level procedure in turn, and the
+// program node itself before the procedures (pre_order) or after them
+// (post_order) if it asks for that.
+class FusedPass
+{
+  public:
+    enum Order
+    {
+        pre_order = 1,
+        post_order = 2
+    };
+
+    virtual ~FusedPass() {}
+
+    // The program hooks this pass needs, pre_order and/or post_order
+    virtual int order() = 0;
+
+    // The program node, when is pre_order or post_order
+    virtual void program(ProgramImpl* p, Order when) {}
+
+    // One top level procedure, nested procedures and all
+    virtual void proc(ProcImpl* p) = 0;
+};
+
+// Runs passes fused: each top level procedure goes through every pass,
+// in the order they were added, before the next one is started.  A big
+// program is then read from memory once, while each procedure's nodes are
+// still in cache, instead of once per pass.  The passes are deleted with
+// the manager.
+class PassManager
+{
+  private:
+    std::vector<FusedPass*> m_passes;
+    std::vector<FusedPass*> m_pre;      // Those with a pre_order hook
+    std::vector<FusedPass*> m_post;     // and with a post_order one
+
+  public:
+    ~PassManager();
+
+    void add(FusedPass* pass);
+    void run(Program_ptr ast);
+};
+
+#endif //PASSMANAGER_HPP
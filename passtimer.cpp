@@ -0,0 +1,200 @@
+#include <cstdio>
+#include <ctime>
+
+#include <malloc.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "ast.hpp"
+#include "passtimer.hpp"
+#include "eventtrace.hpp"
+#include "probes.hpp"
+
+static double wall_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double cpu_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long peak_rss_kb()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+static long current_rss_kb()
+{
+    long pages = 0, resident = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if(f == NULL) {
+        return -1;
+    }
+    if(fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+        resident = -1;
+    }
+    fclose(f);
+    return resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static long heap_in_use_kb()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 mi = mallinfo2();
+    return (long)((mi.uordblks + mi.hblkhd) / 1024);
+#else
+    return -1;
+#endif
+}
+
+PassTimer::PassTimer()
+{
+    m_running = false;
+    m_wall_start = 0;
+    m_cpu_start = 0;
+    m_trace_start = 0;
+    m_perf = NULL;
+}
+
+PassTimer::~PassTimer()
+{
+    delete m_perf;
+}
+
+bool PassTimer::enable_perf()
+{
+    PerfCounters* perf = new PerfCounters();
+    bool ok = perf->open();
+    m_perf_error = perf->error();
+    if(!ok) {
+        delete perf;
+        return false;
+    }
+    m_perf = perf;
+    return true;
+}
+
+void PassTimer::start(const char* name)
+{
+    stop();
+    m_cur.name = name;
+    m_running = true;
+    CSIMPLE_PROBE1(phase__start, name);
+    m_wall_start = wall_now();
+    m_cpu_start = cpu_now();
+    if(event_trace) {
+        m_trace_start = event_trace->now();
+    }
+    if(m_perf) {
+        m_perf->read(m_counts_start);
+    }
+}
+
+void PassTimer::stop()
+{
+    if(!m_running) {
+        return;
+    }
+    long long counts[PerfCounters::num_counters];
+    if(m_perf) {
+        m_perf->read(counts);
+    }
+    for(int i = 0; i < PerfCounters::num_counters; i++) {
+        m_cur.counts[i] = -1;
+        if(m_perf && counts[i] >= 0 && m_counts_start[i] >= 0) {
+            m_cur.counts[i] = counts[i] - m_counts_start[i];
+        }
+    }
+    m_cur.wall = wall_now() - m_wall_start;
+    m_cur.cpu = cpu_now() - m_cpu_start;
+    m_cur.peak_kb = peak_rss_kb();
+    m_cur.rss_kb = current_rss_kb();
+    m_cur.heap_kb = heap_in_use_kb();
+    m_phases.push_back(m_cur);
+    m_running = false;
+    CSIMPLE_PROBE2(phase__done, m_cur.name, (long long)(m_cur.wall * 1e9));
+    if(event_trace) {
+        event_trace->span("phase", m_cur.name, m_trace_start);
+    }
+}
+
+void PassTimer::report(FILE* f, bool times, bool mem)
+{
+    stop();
+
+    fprintf(f, "===== csimple pass report =====\n");
+    fprintf(f, "%-12s", "phase");
+    if(times) {
+        fprintf(f, " %10s %10s", "wall(s)", "cpu(s)");
+    }
+    if(mem) {
+        fprintf(f, " %12s %12s %12s", "peak(kB)", "rss(kB)", "heap(kB)");
+    }
+    if(m_perf) {
+        for(int i = 0; i < PerfCounters::num_counters; i++) {
+            fprintf(f, " %14s", PerfCounters::name(i));
+        }
+        fprintf(f, " %6s", "IPC");
+    }
+    fprintf(f, "\n");
+
+    double wall = 0, cpu = 0;
+    for(size_t i = 0; i < m_phases.size(); i++) {
+        Phase& p = m_phases[i];
+        wall += p.wall;
+        cpu += p.cpu;
+        fprintf(f, "%-12s", p.name);
+        if(times) {
+            fprintf(f, " %10.4f %10.4f", p.wall, p.cpu);
+        }
+        if(mem) {
+            fprintf(f, " %12ld %12ld %12ld", p.peak_kb, p.rss_kb, p.heap_kb);
+        }
+        if(m_perf) {
+            for(int c = 0; c < PerfCounters::num_counters; c++) {
+                if(p.counts[c] >= 0) {
+                    fprintf(f, " %14lld", p.counts[c]);
+                } else {
+                    fprintf(f, " %14s", "-");
+                }
+            }
+            long long cyc = p.counts[PerfCounters::cycles];
+            long long ins = p.counts[PerfCounters::instructions];
+            if(cyc > 0 && ins >= 0) {
+                fprintf(f, " %6.2f", (double)ins / cyc);
+            } else {
+                fprintf(f, " %6s", "-");
+            }
+        }
+        fprintf(f, "\n");
+    }
+    if(times) {
+        fprintf(f, "%-12s %10.4f %10.4f\n", "total", wall, cpu);
+    }
+    if(!m_perf_error.empty()) {
+        fprintf(f, "perf counters unavailable (%s)\n", m_perf_error.c_str());
+    }
+
+    if(mem) {
+        unsigned long count = 0, bytes = 0;
+        fprintf(f, "\nAST allocations by class:\n");
+        fprintf(f, "%-22s %12s %14s\n", "class", "objects", "bytes");
+        for(int i = 0; i < ast_num_classes; i++) {
+            AstAllocStat& a = ast_alloc_stats[i];
+            count += a.count;
+            bytes += a.bytes;
+            if(a.count != 0) {
+                fprintf(f, "%-22s %12lu %14lu\n", a.name, a.count, a.bytes);
+            }
+        }
+        fprintf(f, "%-22s %12lu %14lu\n", "total", count, bytes);
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef PASSTIMER_HPP
+#define PASSTIMER_HPP
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "perfcounters.hpp"
+
+// Measures each phase of csimple (parse, typecheck, ast2dot) for
+// --time-passes and --mem-report: wall and CPU time, plus peak and
+// retained memory when the phase ends.  With --perf-counters it also
+// counts hardware events per phase.
+class PassTimer
+{
+  private:
+    struct Phase
+    {
+        const char* name;
+        double wall;        // seconds
+        double cpu;         // seconds, user + system
+        long peak_kb;       // peak RSS so far
+        long rss_kb;        // RSS at the end of the phase
+        long heap_kb;       // malloc'd bytes in use at the end, -1 if unknown
+        long long counts[PerfCounters::num_counters];  // -1 if not counted
+    };
+    std::vector<Phase> m_phases;
+    Phase m_cur;
+    bool m_running;
+    double m_wall_start;
+    double m_cpu_start;
+    double m_trace_start;       // event_trace->now() at start
+    PerfCounters* m_perf;       // NULL unless enable_perf found counters
+    std::string m_perf_error;
+    long long m_counts_start[PerfCounters::num_counters];
+
+  public:
+    PassTimer();
+    ~PassTimer();
+
+    // Also count hardware events for each phase.  Returns false (and the
+    // report says why) if perf events are not permitted here.
+    bool enable_perf();
+
+    // Begin timing a phase; name must outlive the timer.  Phases also
+    // become spans in event_trace when --trace-events is on.
+    void start(const char* name);
+
+    // End the current phase, if there is one
+    void stop();
+
+    // Print the finished phases (ending the current one first) and, for
+    // mem, the AST allocations by node class
+    void report(FILE* f, bool times, bool mem);
+};
+
+#endif //PASSTIMER_HPP
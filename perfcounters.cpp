@@ -0,0 +1,87 @@
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include "perfcounters.hpp"
+
+PerfCounters::PerfCounters()
+{
+    for(int i = 0; i < num_counters; i++) {
+        m_fd[i] = -1;
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    for(int i = 0; i < num_counters; i++) {
+        if(m_fd[i] >= 0) {
+            close(m_fd[i]);
+        }
+    }
+}
+
+const char* PerfCounters::name(int counter)
+{
+    switch(counter) {
+        case cycles:        return "cycles";
+        case instructions:  return "instructions";
+        case cache_misses:  return "cache-misses";
+        case branch_misses: return "branch-misses";
+        default:            return "?";
+    }
+}
+
+bool PerfCounters::open()
+{
+#ifdef __linux__
+    static const unsigned long long config[num_counters] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    int opened = 0;
+    for(int i = 0; i < num_counters; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config[i];
+        attr.exclude_kernel = 1;    // allowed at perf_event_paranoid 2
+        attr.exclude_hv = 1;
+        attr.inherit = 1;           // count --dot-jobs worker threads too
+
+        m_fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if(m_fd[i] >= 0) {
+            opened++;
+        } else {
+            if(!m_error.empty()) {
+                m_error += ", ";
+            }
+            m_error += std::string(name(i)) + ": " + strerror(errno);
+        }
+    }
+    return opened > 0;
+#else
+    m_error = "perf_event_open is only available on Linux";
+    return false;
+#endif
+}
+
+void PerfCounters::read(long long values[num_counters])
+{
+    for(int i = 0; i < num_counters; i++) {
+        values[i] = -1;
+        long long v;
+        if(m_fd[i] >= 0 && ::read(m_fd[i], &v, sizeof(v)) == sizeof(v)) {
+            values[i] = v;
+        }
+    }
+}
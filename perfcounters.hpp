@@ -0,0 +1,35 @@
+#ifndef PERFCOUNTERS_HPP
+#define PERFCOUNTERS_HPP
+
+#include <string>
+
+// Hardware counters for this process through perf_event_open(2): cycles,
+// instructions, cache misses and branch misses, user space only.  Any
+// counter the kernel or machine will not give us reads as -1, so callers
+// can always use it and just print less.
+class PerfCounters
+{
+  public:
+    enum { cycles, instructions, cache_misses, branch_misses, num_counters };
+
+  private:
+    int m_fd[num_counters];
+    std::string m_error;
+
+  public:
+    PerfCounters();
+    ~PerfCounters();
+
+    // Try to open every counter; false if none could be opened
+    bool open();
+
+    // Why open failed (or which counters are missing), empty if all is well
+    const std::string& error() { return m_error; }
+
+    // Current counts, -1 for counters that are not open
+    void read(long long values[num_counters]);
+
+    static const char* name(int counter);
+};
+
+#endif //PERFCOUNTERS_HPP
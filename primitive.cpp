@@ -63,12 +63,12 @@ StringPrimitive::StringPrimitive(const StringPrimitive & other)
 
 StringPrimitive::~StringPrimitive()
 {
-    delete (m_string);
+    // The string comes from strdup, in the lexer or the copy constructor
+    free(m_string);
 }
 
 StringPrimitive& StringPrimitive::operator=(const StringPrimitive & other)
 {
-    delete m_string;
     StringPrimitive tmp(other);
     swap(tmp);
     return *this;
@@ -0,0 +1,11 @@
+#include "probes.hpp"
+
+#ifdef CSIMPLE_HAVE_SDT
+
+#define CSIMPLE_SEMAPHORE(name) \
+    __extension__ unsigned short csimple_##name##_semaphore \
+        __attribute__((unused)) __attribute__((section(".probes")));
+CSIMPLE_PROBE_LIST(CSIMPLE_SEMAPHORE)
+#undef CSIMPLE_SEMAPHORE
+
+#endif
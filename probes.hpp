@@ -0,0 +1,67 @@
+#ifndef PROBES_HPP
+#define PROBES_HPP
+
+// USDT static probes (provider "csimple") for tracing a running checker
+// with bpftrace, perf or systemtap, e.g.
+//
+//   bpftrace -e 'usdt:./csimple:csimple:proc__done
+//                { @nodes[str(arg0)] = arg2; }'
+//
+// Every probe is a single nop until a tracer attaches, so they are always
+// compiled in.  Arguments that cost something to compute are guarded with
+// CSIMPLE_PROBE_ENABLED, which reads the probe's semaphore.  Without
+// <sys/sdt.h> (or with -DCSIMPLE_NO_SDT) the probes compile to nothing.
+//
+//   phase__start(name)                  phase__done(name, wall_ns)
+//   proc__start(name, depth)            proc__done(name, depth, nodes, scopes)
+//   scope__open(id, depth)              scope__close(id, depth, symbols)
+//   error(kind, lineno)
+
+#define CSIMPLE_PROBE_LIST(X) \
+    X(phase__start) X(phase__done) X(proc__start) X(proc__done) \
+    X(scope__open) X(scope__close) X(error)
+
+#if !defined(CSIMPLE_NO_SDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define CSIMPLE_HAVE_SDT 1
+#endif
+#endif
+
+#ifdef CSIMPLE_HAVE_SDT
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+// A tracer bumps a probe's semaphore while it is attached.  They are
+// defined in probes.cpp.
+#define CSIMPLE_SEMAPHORE(name) \
+    __extension__ extern unsigned short csimple_##name##_semaphore \
+        __attribute__((unused)) __attribute__((section(".probes")));
+CSIMPLE_PROBE_LIST(CSIMPLE_SEMAPHORE)
+#undef CSIMPLE_SEMAPHORE
+
+#define CSIMPLE_PROBE_ENABLED(name) \
+    __builtin_expect(csimple_##name##_semaphore != 0, 0)
+#define CSIMPLE_PROBE1(name, a) STAP_PROBE1(csimple, name, a)
+#define CSIMPLE_PROBE2(name, a, b) STAP_PROBE2(csimple, name, a, b)
+#define CSIMPLE_PROBE3(name, a, b, c) STAP_PROBE3(csimple, name, a, b, c)
+#define CSIMPLE_PROBE4(name, a, b, c, d) \
+    STAP_PROBE4(csimple, name, a, b, c, d)
+
+#else
+
+// The arguments are still named (but never evaluated) so variables kept
+// only for probes do not look unused
+#define CSIMPLE_PROBE_ENABLED(name) 0
+#define CSIMPLE_PROBE1(name, a) do { (void)sizeof(a); } while(0)
+#define CSIMPLE_PROBE2(name, a, b) \
+    do { (void)sizeof(a); (void)sizeof(b); } while(0)
+#define CSIMPLE_PROBE3(name, a, b, c) \
+    do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while(0)
+#define CSIMPLE_PROBE4(name, a, b, c, d) \
+    do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); \
+         (void)sizeof(d); } while(0)
+
+#endif
+
+#endif //PROBES_HPP
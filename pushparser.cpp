@@ -0,0 +1,159 @@
+#include "ast.hpp"
+#include "parser.hpp"
+#include "pushparser.hpp"
+#include "sourcemap.hpp"
+#include "resourcelimits.hpp"
+
+// The scanner and parser (lexer.l, parser.ypp)
+extern int yychar;
+extern unsigned int yyoffset;
+extern int syntax_errors;
+extern Program_ptr ast;
+void yylex_bytes(const char* data, size_t len,
+                 bool (*push)(int token, void* arg), void* arg);
+
+// Where split has got to in the input, as the scanner will see it
+enum {
+    in_text,
+    in_string,              // "..." (may span lines)
+    in_comment,             // /% ... %/
+    in_comment_percent      // Just after a % in a comment
+};
+
+PushParser::PushParser()
+{
+    m_parser = NULL;
+    reset();
+}
+
+PushParser::~PushParser()
+{
+    yypstate_delete(m_parser);
+}
+
+void PushParser::reset()
+{
+    if(m_parser) {
+        yypstate_delete(m_parser);
+    }
+    m_parser = yypstate_new();
+    m_status = need_more;
+    m_pending.clear();
+    m_seen = 0;
+    m_split = 0;
+    m_mode = in_text;
+    yyoffset = 0;
+    source_map.clear();
+    resource_usage = ResourceUsage();
+    limit_hit = 0;
+    syntax_errors = 0;
+    ast = NULL;
+}
+
+// Move m_split past the last blank of m_pending that lies between two
+// tokens.  Tokens never contain blanks, so the scanner can stop there
+// without having to resume part way through one.  Strings and comments
+// do contain them, and are followed the way lexer.l reads them.
+void PushParser::split()
+{
+    size_t i = m_seen;
+    size_t n = m_pending.size();
+    const char* s = m_pending.data();
+    while(i < n) {
+        char c = s[i];
+        if(m_mode == in_string) {
+            if(c == '"') {
+                m_mode = in_text;
+            }
+            i++;
+        } else if(m_mode == in_comment) {
+            if(c == '%') {
+                m_mode = in_comment_percent;
+            }
+            i++;
+        } else if(m_mode == in_comment_percent) {
+            // Whatever follows the % is used up, even another %
+            m_mode = c == '/' ? in_text : in_comment;
+            i++;
+        } else if(c == ' ' || c == '\t' || c == '\n') {
+            i++;
+            m_split = i;
+        } else if(c == '"') {
+            m_mode = in_string;
+            i++;
+        } else if(c == '/' || c == '\'') {
+            // Needs the next bytes to tell a comment or a character
+            // literal (which may be a blank or a quote) from a lone / or '
+            if(c == '/' && i + 1 < n) {
+                if(s[i + 1] == '%') {
+                    m_mode = in_comment;
+                    i += 2;
+                } else {
+                    i++;
+                }
+            } else if(c == '\'' && i + 2 < n) {
+                bool literal = s[i + 2] == '\'' && s[i + 1] >= 040 && s[i + 1] <= 0176;
+                i += literal ? 3 : 1;
+            } else {
+                break;
+            }
+        } else {
+            i++;
+        }
+    }
+    m_seen = i;
+}
+
+// Scan and parse the first len bytes of m_pending
+void PushParser::scan(size_t len)
+{
+    yylex_bytes(m_pending.data(), len, push, this);
+    m_pending.erase(0, len);
+    m_seen -= len;
+    m_split = 0;
+}
+
+bool PushParser::push(int token, void* arg)
+{
+    PushParser* p = (PushParser*)arg;
+    yychar = token;
+    int r = yypush_parse(p->m_parser);
+    if(limit_hit) {
+        // Where csimple would have exited; the rest is ignored
+        p->m_status = failed;
+        return false;
+    }
+    if(r == YYPUSH_MORE) {
+        return true;
+    }
+    p->m_status = r == 0 ? done : failed;
+    return false;
+}
+
+PushParser::Status PushParser::feed(const char* data, size_t len)
+{
+    if(m_status != need_more) {
+        return m_status;
+    }
+    m_pending.append(data, len);
+    split();
+    if(m_split > 0) {
+        scan(m_split);
+    }
+    return m_status;
+}
+
+PushParser::Status PushParser::finish()
+{
+    if(m_status == need_more && !m_pending.empty()) {
+        scan(m_pending.size());
+    }
+    if(m_status == need_more) {
+        push(0, this);      // End of input
+    }
+    if(syntax_errors > 0) {
+        // From the scanner, which carries on after an invalid character
+        m_status = failed;
+    }
+    return m_status;
+}
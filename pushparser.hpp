@@ -0,0 +1,55 @@
+#ifndef PUSHPARSER_HPP
+#define PUSHPARSER_HPP
+
+#include <cstddef>
+#include <string>
+
+struct yypstate;
+
+// Parses a program handed over in pieces of any size, as they arrive,
+// instead of pulling it all through yyin.  Each feed scans and parses every
+// complete token so far; the rest (the end of the input, which may stop
+// part way through a token, string or comment) waits for the next feed.
+// The finished tree is left in the global ast, as with yyparse.
+//
+// As with yyparse, a syntax error exits unless syntax_error_exits has been
+// cleared (see parser.ypp), in which case the parse reports failed.
+class PushParser
+{
+  public:
+    enum Status {
+        need_more,      // Fine so far, feed more or finish
+        done,           // The whole program parsed, ast is set
+        failed          // A syntax error; further input is ignored
+    };
+
+  private:
+    yypstate* m_parser;
+    Status m_status;
+    std::string m_pending;      // Input not yet scanned
+    size_t m_seen;              // How much of m_pending the split scan has seen
+    size_t m_split;             // Where the next token starts, 0 if unknown
+    int m_mode;                 // Where the split scan is (see pushparser.cpp)
+
+    void split();
+    void scan(size_t len);
+    static bool push(int token, void* arg);
+
+  public:
+    PushParser();
+    ~PushParser();
+
+    // Start again on a new program, keeping the buffers
+    void reset();
+
+    // Parse as much as possible of the input so far, which continues with
+    // the len bytes at data
+    Status feed(const char* data, size_t len);
+
+    // The input has ended: parse the rest and return done or failed
+    Status finish();
+
+    Status status() { return m_status; }
+};
+
+#endif //PUSHPARSER_HPP
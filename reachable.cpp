@@ -0,0 +1,72 @@
+#include <map>
+#include <string>
+#include <vector>
+
+#include "reachable.hpp"
+#include "symtab.hpp"
+
+// Collects the names called under a procedure.  Only statements can hold
+// calls, so expressions are not walked.
+class CallNames : public WalkVisitor
+{
+  public:
+    std::set<std::string> m_names;
+
+    void visitCall(Call* p) { m_names.insert(p->m_symname->spelling()); }
+    void visitAssignment(Assignment* p) {}
+    void visitStringAssignment(StringAssignment* p) {}
+    void visitReturn(Return* p) {}
+    void visitDeclImpl(DeclImpl* p) {}
+};
+
+Reachable::Reachable()
+{
+    m_total = 0;
+    m_skipped = 0;
+}
+
+void Reachable::plan(ProgramImpl* prog)
+{
+    std::multimap<std::string, ProcImpl*> by_name;
+    std::map<ProcImpl*, std::set<std::string> > calls;
+    for(std::list<Proc_ptr>::iterator i = prog->m_proc_list->begin();
+            i != prog->m_proc_list->end(); ++i) {
+        ProcImpl* p = dynamic_cast<ProcImpl*>(*i);
+        if(p == NULL) {
+            continue;
+        }
+        m_total++;
+        by_name.insert(std::make_pair(p->m_symname->spelling(), p));
+        CallNames walk;
+        p->m_procedure_block->accept(&walk);
+        calls[p].swap(walk.m_names);
+    }
+
+    std::vector<std::string> todo(1, "Main");
+    std::set<std::string> seen(todo.begin(), todo.end());
+    while(!todo.empty()) {
+        std::string name = todo.back();
+        todo.pop_back();
+        typedef std::multimap<std::string, ProcImpl*>::iterator It;
+        std::pair<It, It> procs = by_name.equal_range(name);
+        for(It i = procs.first; i != procs.second; ++i) {
+            m_reached.insert(i->second);
+            std::set<std::string>& called = calls[i->second];
+            for(std::set<std::string>::iterator c = called.begin();
+                    c != called.end(); ++c) {
+                if(seen.insert(*c).second) {
+                    todo.push_back(*c);
+                }
+            }
+        }
+    }
+}
+
+bool Reachable::skip(ProcImpl* p)
+{
+    if(m_reached.count(p)) {
+        return false;
+    }
+    m_skipped++;
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef REACHABLE_HPP
+#define REACHABLE_HPP
+
+#include <set>
+
+#include "ast.hpp"
+
+// Triage for --reachable-only: only the top level procedures that Main can
+// reach are type checked.  The call graph is built by name from the Call
+// statements under each top level procedure (nested procedures included)
+// before checking starts, so a call reaches every top level procedure of
+// that name; this may keep a procedure that a full resolution would drop,
+// never the reverse.  Skipped procedures are still entered into the global
+// scope, so duplicate names and calls to them are checked as usual.
+class Reachable
+{
+  private:
+    std::set<ProcImpl*> m_reached;
+    int m_total;
+    int m_skipped;
+
+  public:
+    Reachable();
+
+    // Build the call graph of prog and walk it from Main
+    void plan(ProgramImpl* prog);
+
+    // True if the top level procedure p is not reachable from Main
+    bool skip(ProcImpl* p);
+
+    int skipped() { return m_skipped; }
+    int total() { return m_total; }
+};
+
+#endif //REACHABLE_HPP
@@ -0,0 +1,64 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "resourcelimits.hpp"
+
+ResourceLimits resource_limits = { 0, 0, 10000, 0, 0 };
+ResourceUsage resource_usage;
+bool limit_exits = true;
+int limit_hit = 0;
+
+int limit_report(LimitKind kind)
+{
+    const char* what;
+    const char* option;
+    unsigned long limit;
+    switch(kind)
+    {
+        case limit_input_bytes:
+            what = "bytes of input";
+            option = "--max-input-bytes";
+            limit = resource_limits.input_bytes;
+            break;
+        case limit_nodes:
+            what = "AST nodes";
+            option = "--max-nodes";
+            limit = resource_limits.nodes;
+            break;
+        case limit_depth:
+            what = "levels of AST nesting";
+            option = "--max-depth";
+            limit = resource_limits.depth;
+            break;
+        case limit_scopes:
+            what = "scopes";
+            option = "--max-scopes";
+            limit = resource_limits.scopes;
+            break;
+        case limit_ast_bytes:
+            what = "bytes of AST";
+            option = "--max-ast-bytes";
+            limit = resource_limits.ast_bytes;
+            break;
+        default:
+            abort();
+    }
+    fprintf(stderr, "resource limit exceeded: more than %lu %s (%s)\n",
+            limit, what, option);
+    return limit_exit_base + kind;
+}
+
+void limit_exceeded(LimitKind kind)
+{
+    exit(limit_report(kind));
+}
+
+void limit_note(LimitKind kind)
+{
+    if(limit_exits) {
+        limit_exceeded(kind);
+    }
+    if(limit_hit == 0) {
+        limit_hit = limit_report(kind);
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef RESOURCELIMITS_HPP
+#define RESOURCELIMITS_HPP
+
+#include <cstddef>
+
+// Caps on what one run may use, for programs from untrusted sources: a
+// pathological one (a huge file or string, thousands of nested blocks or
+// chained operators) ends the run with a message and an exit code of its
+// own, not by exhausting memory or the stack.  Each cap is checked where
+// what it limits is allocated: input as the scanner reads it, nodes, depth
+// and AST bytes in the AST constructors, scopes in SymTab::open_scope.
+// --ast-in rebuilds a tree top down, so it checks depth on the way down
+// (AstBinRebuild::enter).
+// 0 means no limit.
+struct ResourceLimits
+{
+    unsigned long input_bytes;  // --max-input-bytes
+    unsigned long nodes;        // --max-nodes
+    unsigned int depth;         // --max-depth, of the AST.  The passes that
+                                // walk it recurse, so this is on by default,
+                                // and never more than Attribute::max_depth
+    unsigned long scopes;       // --max-scopes, opened over the whole check
+    unsigned long ast_bytes;    // --max-ast-bytes, as --mem-report counts them
+};
+
+// Which limit a run went over; csimple exits with limit_exit_base + it
+enum LimitKind
+{
+    limit_input_bytes,
+    limit_nodes,
+    limit_depth,
+    limit_scopes,
+    limit_ast_bytes
+};
+enum { limit_exit_base = 40 };
+
+// What this run has used so far of what the limits cover (scopes are
+// counted by the SymTab)
+struct ResourceUsage
+{
+    unsigned long input_bytes;
+    unsigned long nodes;
+    unsigned long ast_bytes;
+};
+
+extern ResourceLimits resource_limits;
+extern ResourceUsage resource_usage;
+
+// Print which limit was exceeded and return its exit code
+int limit_report(LimitKind kind);
+
+// The same, then exit with that code
+void limit_exceeded(LimitKind kind) __attribute__((noreturn));
+
+// csimple --daemon clears limit_exits, as it must outlive a program over a
+// limit.  limit_hit then takes the exit code of the first limit a check
+// goes over, and the parser and Diagnostics stop where csimple would have
+// exited; the daemon replies with that code.
+extern bool limit_exits;
+extern int limit_hit;
+
+// Over a limit that the daemon survives: limit_exceeded, unless
+// limit_exits is cleared; then the first is reported into limit_hit
+void limit_note(LimitKind kind);
+
+// The scanner has read n more bytes
+inline void limit_input(size_t n)
+{
+    resource_usage.input_bytes += n;
+    if(resource_limits.input_bytes
+            && resource_usage.input_bytes > resource_limits.input_bytes) {
+        limit_exceeded(limit_input_bytes);
+    }
+}
+
+// An AST constructor has built a node of bytes at depth (1 for a leaf)
+inline void limit_ast_node(unsigned int depth, size_t bytes)
+{
+    resource_usage.nodes++;
+    resource_usage.ast_bytes += bytes;
+    if(resource_limits.nodes && resource_usage.nodes > resource_limits.nodes) {
+        limit_note(limit_nodes);
+    }
+    if(resource_limits.depth && depth > resource_limits.depth) {
+        limit_note(limit_depth);
+    }
+    if(resource_limits.ast_bytes
+            && resource_usage.ast_bytes > resource_limits.ast_bytes) {
+        limit_note(limit_ast_bytes);
+    }
+}
+
+#endif //RESOURCELIMITS_HPP
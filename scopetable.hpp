@@ -0,0 +1,256 @@
+#ifndef SCOPETABLE_HPP
+#define SCOPETABLE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+class Symbol;
+
+// Storage policies for one level of SymTab scope.  SymScope stores its
+// names through whichever of these is selected as SYMTAB_POLICY in
+// symtab.cpp, so they all provide the same interface:
+//
+//   Symbol* find(const char* name) const;
+//       the symbol for name, or NULL if it is not in this table
+//   Symbol* insert(const char* name, Symbol* s);
+//       NULL on success, otherwise the symbol already bound to name.
+//       The table keeps the name pointer; it does not copy the string.
+//   bool holds_key(const char* name) const;
+//       true if this exact pointer is already a key in the table
+//   size_t size() const;
+//   size_t buckets() const;
+//       hash buckets or slots allocated, 0 if the table does not hash
+//   template<class F> void for_each(F f) const;
+//       calls f(const char* name, Symbol* s) on every entry
+//   void clear();
+//       removes every entry but keeps the storage for reuse
+
+// FNV-1a over a NUL terminated name
+inline unsigned int scopetable_hash(const char* name)
+{
+    unsigned int h = 2166136261u;
+    for(const char* c = name; *c; ++c) {
+        h ^= (unsigned char)*c;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/****** NodeMapTable ***********************************************/
+
+// The original layout: a node-based std::unordered_map, keyed directly on
+// the name pointer so lookups do not build a std::string
+class NodeMapTable
+{
+  private:
+    struct NameHash {
+        size_t operator()(const char* n) const { return scopetable_hash(n); }
+    };
+    struct NameEq {
+        bool operator()(const char* a, const char* b) const
+        {
+            return !strcmp(a, b);
+        }
+    };
+    typedef std::unordered_map<const char*, Symbol*, NameHash, NameEq> MapType;
+    MapType m_map;
+
+  public:
+    Symbol* find(const char* name) const
+    {
+        MapType::const_iterator i = m_map.find(name);
+        return i != m_map.end() ? i->second : NULL;
+    }
+
+    Symbol* insert(const char* name, Symbol* s)
+    {
+        std::pair<MapType::iterator, bool> r =
+            m_map.insert(std::make_pair(name, s));
+        return r.second ? NULL : r.first->second;
+    }
+
+    bool holds_key(const char* name) const
+    {
+        MapType::const_iterator i = m_map.find(name);
+        return i != m_map.end() && i->first == name;
+    }
+
+    size_t size() const { return m_map.size(); }
+    size_t buckets() const { return m_map.bucket_count(); }
+    void clear() { m_map.clear(); }
+
+    template<class F> void for_each(F f) const
+    {
+        for(MapType::const_iterator i = m_map.begin(); i != m_map.end(); ++i) {
+            f(i->first, i->second);
+        }
+    }
+};
+
+/****** FlatMapTable ***********************************************/
+
+// Open addressing with linear probing in one contiguous array of
+// (hash, name, symbol) slots.  Kept at most half full.
+class FlatMapTable
+{
+  private:
+    struct Slot {
+        unsigned int hash;
+        const char* name;
+        Symbol* symbol;
+    };
+    std::vector<Slot> m_slots;
+    size_t m_size;
+
+    size_t probe(unsigned int h, const char* name) const
+    {
+        size_t mask = m_slots.size() - 1;
+        size_t i = h & mask;
+        while(m_slots[i].name != NULL) {
+            if(m_slots[i].hash == h && !strcmp(m_slots[i].name, name)) {
+                break;
+            }
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    void grow()
+    {
+        std::vector<Slot> old;
+        old.swap(m_slots);
+        Slot empty = { 0, NULL, NULL };
+        m_slots.assign(old.empty() ? 8 : old.size() * 2, empty);
+        size_t mask = m_slots.size() - 1;
+        for(size_t j = 0; j < old.size(); j++) {
+            if(old[j].name == NULL) {
+                continue;
+            }
+            size_t i = old[j].hash & mask;
+            while(m_slots[i].name != NULL) {
+                i = (i + 1) & mask;
+            }
+            m_slots[i] = old[j];
+        }
+    }
+
+  public:
+    FlatMapTable() { m_size = 0; }
+
+    Symbol* find(const char* name) const
+    {
+        if(m_size == 0) {
+            return NULL;
+        }
+        return m_slots[probe(scopetable_hash(name), name)].symbol;
+    }
+
+    Symbol* insert(const char* name, Symbol* s)
+    {
+        if(2 * (m_size + 1) > m_slots.size()) {
+            grow();
+        }
+        unsigned int h = scopetable_hash(name);
+        size_t i = probe(h, name);
+        if(m_slots[i].name != NULL) {
+            return m_slots[i].symbol;
+        }
+        m_slots[i].hash = h;
+        m_slots[i].name = name;
+        m_slots[i].symbol = s;
+        m_size++;
+        return NULL;
+    }
+
+    bool holds_key(const char* name) const
+    {
+        if(m_size == 0) {
+            return false;
+        }
+        return m_slots[probe(scopetable_hash(name), name)].name == name;
+    }
+
+    size_t size() const { return m_size; }
+    size_t buckets() const { return m_slots.size(); }
+
+    void clear()
+    {
+        Slot empty = { 0, NULL, NULL };
+        std::fill(m_slots.begin(), m_slots.end(), empty);
+        m_size = 0;
+    }
+
+    template<class F> void for_each(F f) const
+    {
+        for(size_t i = 0; i < m_slots.size(); i++) {
+            if(m_slots[i].name != NULL) {
+                f(m_slots[i].name, m_slots[i].symbol);
+            }
+        }
+    }
+};
+
+/****** LinearTable ************************************************/
+
+// An unsorted array scanned front to back.  Most scopes hold a handful of
+// names, where this beats hashing; it degrades linearly on big scopes.
+class LinearTable
+{
+  private:
+    struct Entry {
+        const char* name;
+        Symbol* symbol;
+    };
+    std::vector<Entry> m_entries;
+
+    int index_of(const char* name) const
+    {
+        for(size_t i = 0; i < m_entries.size(); i++) {
+            const char* n = m_entries[i].name;
+            if(n[0] == name[0] && !strcmp(n, name)) {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+  public:
+    Symbol* find(const char* name) const
+    {
+        int i = index_of(name);
+        return i >= 0 ? m_entries[i].symbol : NULL;
+    }
+
+    Symbol* insert(const char* name, Symbol* s)
+    {
+        int i = index_of(name);
+        if(i >= 0) {
+            return m_entries[i].symbol;
+        }
+        Entry e = { name, s };
+        m_entries.push_back(e);
+        return NULL;
+    }
+
+    bool holds_key(const char* name) const
+    {
+        int i = index_of(name);
+        return i >= 0 && m_entries[i].name == name;
+    }
+
+    size_t size() const { return m_entries.size(); }
+    size_t buckets() const { return 0; }
+    void clear() { m_entries.clear(); }
+
+    template<class F> void for_each(F f) const
+    {
+        for(size_t i = 0; i < m_entries.size(); i++) {
+            f(m_entries[i].name, m_entries[i].symbol);
+        }
+    }
+};
+
+#endif //SCOPETABLE_HPP
@@ -0,0 +1,19 @@
+#include <algorithm>
+
+#include "sourcemap.hpp"
+
+SourceMap source_map;
+
+int SourceMap::line(unsigned int offset) const
+{
+    // Lines that start at or before offset, plus the first
+    return std::upper_bound(m_starts.begin(), m_starts.end(), offset)
+        - m_starts.begin() + 1;
+}
+
+int SourceMap::column(unsigned int offset) const
+{
+    int l = line(offset);
+    unsigned int start = l > 1 ? m_starts[l - 2] : 0;
+    return offset - start + 1;
+}
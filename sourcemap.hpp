@@ -0,0 +1,34 @@
+#ifndef SOURCEMAP_HPP
+#define SOURCEMAP_HPP
+
+#include <vector>
+
+// Where each line of the program being checked starts.  A node keeps only
+// the byte offset of its first token (Attribute::m_offset); the scanner
+// notes every newline here as it goes, and the line and column of an
+// offset are looked up (a binary search) only when a message needs them.
+class SourceMap
+{
+  private:
+    std::vector<unsigned int> m_starts;     // Of every line but the first
+
+  public:
+    // Forget the lines, for a new program
+    void clear() { m_starts.clear(); }
+
+    // A line starts at offset, just after a newline.  Offsets only grow.
+    void newline(unsigned int offset) { m_starts.push_back(offset); }
+
+    // Line and column of offset, both counted from 1
+    int line(unsigned int offset) const;
+    int column(unsigned int offset) const;
+
+    // The starts of the lines after the first, for saving with a tree
+    const std::vector<unsigned int>& starts() const { return m_starts; }
+    void assign(const std::vector<unsigned int>& starts) { m_starts = starts; }
+};
+
+// The scanner's: offsets are into the input it is reading (lexer.l)
+extern SourceMap source_map;
+
+#endif //SOURCEMAP_HPP
@@ -0,0 +1,136 @@
+#include <algorithm>
+
+#include "stats.hpp"
+#include "ast2dot.hpp"
+#include "passmanager.hpp"
+
+AstShape::AstShape()
+{
+    m_counts.assign(ast_num_visit_kinds, 0);
+    m_is_expr.assign(ast_num_visit_kinds, 0);
+    m_is_block.assign(ast_num_visit_kinds, 0);
+    for(int i = 0; i < ast_num_visit_kinds; i++) {
+        const char* base = ast_visit_bases[i];
+        m_is_expr[i] = !strcmp(base, "Expr");
+        m_is_block[i] = !strcmp(base, "Procedure_block")
+                        || !strcmp(base, "Nested_block");
+    }
+    m_depth = m_expr_depth = m_block_depth = 0;
+    max_depth = max_expr_depth = max_block_depth = 0;
+}
+
+long AstShape::total() const
+{
+    long n = 0;
+    for(size_t i = 0; i < m_counts.size(); i++) {
+        n += m_counts[i];
+    }
+    return n;
+}
+
+static double ratio(double a, double b)
+{
+    return b > 0 ? a / b : 0;
+}
+
+// shape_ast as one of the passes of a PassManager.  Nothing comes after
+// the program node, so it need not be left.
+class ShapePass : public FusedPass
+{
+  private:
+    AstShape* m_shape;
+
+  public:
+    ShapePass(AstShape* shape) { m_shape = shape; }
+
+    int order() { return pre_order; }
+    void program(ProgramImpl* p, Order when)
+    {
+        m_shape->enter(ast_kind_ProgramImpl);
+    }
+    void proc(ProcImpl* p) { shape_ast(p, m_shape); }
+};
+
+FusedPass* fused_shape(AstShape* shape)
+{
+    return new ShapePass(shape);
+}
+
+void print_stats(FILE* f, Program_ptr ast, SymTab* st, const AstShape* given)
+{
+    AstShape walked;
+    if(given == NULL) {
+        shape_ast(ast, &walked);
+    }
+    const AstShape& shape = given ? *given : walked;
+    long nodes = shape.total();
+
+    fprintf(f, "===== csimple stats =====\n");
+    fprintf(f, "AST nodes by class:\n");
+    std::vector<int> order;
+    for(int i = 0; i < ast_num_visit_kinds; i++) {
+        if(shape.count(i) != 0) {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&shape](int a, int b) {
+        return shape.count(a) != shape.count(b)
+            ? shape.count(a) > shape.count(b)
+            : strcmp(ast_visit_names[a], ast_visit_names[b]) < 0;
+    });
+    for(size_t i = 0; i < order.size(); i++) {
+        long n = shape.count(order[i]);
+        fprintf(f, "  %-22s %10ld %6.2f%%\n", ast_visit_names[order[i]], n,
+                100 * ratio(n, nodes));
+    }
+    fprintf(f, "  %-22s %10ld\n", "total", nodes);
+    fprintf(f, "max tree depth             %10d\n", shape.max_depth);
+    fprintf(f, "max expression depth       %10d\n", shape.max_expr_depth);
+    fprintf(f, "max block depth            %10d\n", shape.max_block_depth);
+
+    SymTabStats s;
+    st->stats(s);
+    fprintf(f, "\nsymbol table:\n");
+    fprintf(f, "scopes                     %10d\n", s.scopes);
+    fprintf(f, "max scope nesting          %10d\n", s.max_depth);
+    fprintf(f, "symbols                    %10ld\n", s.symbols);
+    fprintf(f, "symbols per scope (avg)    %10.2f\n", ratio(s.symbols, s.scopes));
+    fprintf(f, "symbols per scope (max)    %10d\n", s.max_symbols);
+    for(int c = 0; c < SymTabStats::size_classes; c++) {
+        char label[32];
+        int lo = c == 0 ? 0 : 1 << (c - 1);
+        int hi = (1 << c) - 1;
+        if(c == SymTabStats::size_classes - 1) {
+            snprintf(label, sizeof(label), "%d+", lo);
+        } else if(lo == hi) {
+            snprintf(label, sizeof(label), "%d", lo);
+        } else {
+            snprintf(label, sizeof(label), "%d-%d", lo, hi);
+        }
+        fprintf(f, "  scopes with %-8s       %10d\n", label, s.by_size[c]);
+    }
+    fprintf(f, "buckets                    %10ld\n", s.buckets);
+    fprintf(f, "load factor (overall)      %10.2f\n", ratio(s.symbols, s.buckets));
+    fprintf(f, "load factor (max scope)    %10.2f\n", s.max_load);
+    fprintf(f, "lookups                    %10ld\n", s.lookups);
+    fprintf(f, "scopes probed per lookup   %10.2f\n",
+            ratio(s.lookup_probes, s.lookups));
+    fprintf(f, "lookups not found          %10ld\n", s.lookup_misses);
+
+    // What the numbers say about the alternative layouts
+    long small = 0;
+    for(int c = 0; c < SymTabStats::size_classes && (1 << c) <= 8; c++) {
+        small += s.by_size[c];
+    }
+    unsigned long bytes = 0;
+    for(int i = 0; i < ast_num_classes; i++) {
+        bytes += ast_alloc_stats[i].bytes;
+    }
+    fprintf(f, "\nlayout hints:\n");
+    fprintf(f, "scopes with <= 7 symbols   %9.1f%%  (LinearTable territory, "
+               "compare with make symtab-replay)\n", 100 * ratio(small, s.scopes));
+    fprintf(f, "buckets per symbol         %10.2f  (FlatMapTable needs at most 2)\n",
+            ratio(s.buckets, s.symbols));
+    fprintf(f, "AST bytes allocated        %10lu  (%.1f per node, plus "
+               "std::list links)\n", bytes, ratio(bytes, nodes));
+}
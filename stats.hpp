@@ -0,0 +1,63 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "ast.hpp"
+#include "symtab.hpp"
+
+// Shape of an AST for --stats: node counts by class and the deepest
+// nesting of expressions and of blocks.  It is filled in as the Profile of
+// a VisitProfiled walk (see shape_ast in ast2dot.hpp).
+class AstShape
+{
+  private:
+    std::vector<long> m_counts;     // by visit kind, see ast_visit_names
+    std::vector<char> m_is_expr;
+    std::vector<char> m_is_block;
+    int m_depth, m_expr_depth, m_block_depth;
+
+  public:
+    int max_depth;          // of any node, the root being 1
+    int max_expr_depth;     // Expr nodes nested in one another
+    int max_block_depth;    // procedure and nested blocks
+
+    AstShape();
+
+    void enter(int kind)
+    {
+        m_counts[kind]++;
+        if(++m_depth > max_depth) {
+            max_depth = m_depth;
+        }
+        if(m_is_expr[kind] && ++m_expr_depth > max_expr_depth) {
+            max_expr_depth = m_expr_depth;
+        }
+        if(m_is_block[kind] && ++m_block_depth > max_block_depth) {
+            max_block_depth = m_block_depth;
+        }
+    }
+
+    void leave(int kind)
+    {
+        m_depth--;
+        m_expr_depth -= m_is_expr[kind];
+        m_block_depth -= m_is_block[kind];
+    }
+
+    long count(int kind) const { return m_counts[kind]; }
+    long total() const;
+};
+
+// Print the --stats report for ast and the symbol table it was checked
+// against.  The shape of ast is worked out unless it is given.
+void print_stats(FILE* f, Program_ptr ast, SymTab* st,
+                 const AstShape* shape = NULL);
+
+// Fills in shape as one of the passes of a PassManager
+class FusedPass;
+FusedPass* fused_shape(AstShape* shape);
+
+#endif //STATS_HPP
@@ -1,31 +1,44 @@
 #include <algorithm>
 #include <functional>
-#include <string>
-#include <unordered_map>
+#include <list>
+#include <set>
+#include <vector>
 
 #include <cassert>
+#include <climits>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
 #include "symtab.hpp"
+#include "scopetable.hpp"
+#include "probes.hpp"
+#include "resourcelimits.hpp"
+
+// Storage policy for every scope (see scopetable.hpp).  Select another one
+// at build time with e.g. -DSYMTAB_POLICY=FlatMapTable
+#ifndef SYMTAB_POLICY
+#define SYMTAB_POLICY NodeMapTable
+#endif
 
 /****** SymName Implemenation **************************************/
 
 SymName::SymName(char* const x)
 {
     m_spelling = x;
+    m_symbol = NULL;
     m_parent_attribute = NULL;
 }
 
 SymName::SymName(const SymName & other)
 {
     m_spelling = strdup(other.m_spelling);
+    m_symbol = other.m_symbol;
     m_parent_attribute = other.m_parent_attribute;
 }
 
 SymName& SymName::operator=(const SymName & other)
 {
-    delete m_spelling;
     SymName tmp(other);
     swap(tmp);
     return *this;
@@ -34,11 +47,13 @@ SymName& SymName::operator=(const SymName & other)
 void SymName::swap(SymName & other)
 {
     std::swap(m_spelling, other.m_spelling);
+    std::swap(m_symbol, other.m_symbol);
 }
 
 SymName::~SymName()
 {
-    delete(m_spelling);
+    // The spelling comes from strdup, in the lexer or the copy constructor
+    std::free(m_spelling);
 }
 
 void SymName::accept(Visitor *v)
@@ -90,20 +105,47 @@ class SymScope
   private:
     SymScope* m_parent;
     std::list<SymScope*> m_child;
-    typedef std::unordered_map<std::string, Symbol*> ScopeTableType;
+
+    // Nesting depth (0 for the outermost scope) and the preorder number of
+    // this scope and of its last descendant (-1 while it is still open)
+    // make lexical_distance and ancestry checks constant time
+    int m_depth;
+    int m_id;
+    int m_last_id;
+    bool encloses(SymScope* inner);
+    typedef SYMTAB_POLICY ScopeTableType;
     ScopeTableType m_scopetable;
     int m_scopesize;
+
+    // Read-only copy of m_scopetable built by freeze().  Names point at the
+    // keys of m_scopetable, which the SymTab owns.
+    struct FrozenSlot {
+        unsigned int hash;
+        const char* name;
+        Symbol* symbol;
+    };
+    std::vector<FrozenSlot> m_frozen;
+    unsigned int m_frozen_mask;
+    bool m_is_frozen;
+    void freeze();
+    Symbol* lookup_local(const char* name);
+
     SymScope* parent();
     void add_child(SymScope* c);
     SymScope(SymScope * parent);
     bool is_dup_string(char* name);     // Used for error checking
 
     void dump(FILE* f, int nest_level);
-    SymScope* open_scope();
+    void collect(SymTabStats& out);
+    void init(SymScope* parent);
+    void recycle(std::vector<SymScope*>& spare, std::set<Symbol*>& symbols);
+    SymScope* open_scope(std::vector<SymScope*>& spare);
     SymScope* close_scope();
-    bool exist(char* name);
+    bool exist(const char* name);
     Symbol* insert(char* name, Symbol * s);
-    Symbol* lookup(const char * name);
+    // probes, if given, is incremented for every scope searched
+    Symbol* lookup(const char * name, long* probes = NULL,
+                   int horizon = INT_MAX);
 
   public:
 
@@ -119,11 +161,40 @@ SymTab::SymTab()
 {
     m_head = new SymScope;
     m_cur_scope = m_head;
+    m_trace = NULL;
+    m_next_scope_id = 1;
+    m_lookups = 0;
+    m_lookup_probes = 0;
+    m_lookup_misses = 0;
+    m_horizon = INT_MAX;
+}
+
+void SymTab::set_trace(FILE* f)
+{
+    m_trace = f;
 }
 
 SymTab::~SymTab()
 {
     delete m_head;
+    for(size_t i = 0; i < m_spare.size(); i++) {
+        delete m_spare[i];
+    }
+}
+
+void SymTab::reset()
+{
+    std::set<Symbol*> symbols;
+    m_head->recycle(m_spare, symbols);
+    for(std::set<Symbol*>::iterator i = symbols.begin(); i != symbols.end(); ++i) {
+        delete *i;
+    }
+    m_cur_scope = m_head;
+    m_next_scope_id = 1;
+    m_lookups = 0;
+    m_lookup_probes = 0;
+    m_lookup_misses = 0;
+    m_horizon = INT_MAX;
 }
 
 bool SymTab::is_dup_string(char* name)
@@ -133,8 +204,17 @@ bool SymTab::is_dup_string(char* name)
 
 void SymTab::open_scope()
 {
-    m_cur_scope = m_cur_scope->open_scope();
+    if(m_trace) {
+        std::fprintf(m_trace, "o\n");
+    }
+    m_cur_scope = m_cur_scope->open_scope(m_spare);
     assert(m_cur_scope != NULL);
+    m_cur_scope->m_id = m_next_scope_id++;
+    if(resource_limits.scopes
+            && (unsigned long)m_next_scope_id > resource_limits.scopes) {
+        limit_note(limit_scopes);
+    }
+    CSIMPLE_PROBE2(scope__open, m_cur_scope->m_id, m_cur_scope->m_depth);
 }
 
 void SymTab::close_scope()
@@ -143,6 +223,13 @@ void SymTab::close_scope()
     assert(m_cur_scope != m_head);
     assert(m_cur_scope != NULL);
 
+    if(m_trace) {
+        std::fprintf(m_trace, "c\n");
+    }
+    // Nothing can be nested inside this scope from now on
+    m_cur_scope->m_last_id = m_next_scope_id - 1;
+    CSIMPLE_PROBE3(scope__close, m_cur_scope->m_id, m_cur_scope->m_depth,
+                   (int)m_cur_scope->m_scopetable.size());
     m_cur_scope = m_cur_scope->close_scope();
 }
 
@@ -153,10 +240,13 @@ SymScope* SymTab::get_scope()
     return m_cur_scope;
 }
 
-bool SymTab::exist(char* name)
+bool SymTab::exist(const char* name)
 {
     assert(name != NULL);
-    return m_cur_scope->exist(name);
+    if(m_trace) {
+        std::fprintf(m_trace, "l %s\n", name);
+    }
+    return counted_lookup(m_cur_scope, name) != NULL;
 }
 
 bool SymTab::insert(char* name, Symbol* s)
@@ -168,6 +258,9 @@ bool SymTab::insert(char* name, Symbol* s)
     // can have duplicate names, but each needs to reside it it's
     // own chunk of memory (see example)
     assert(is_dup_string(name));
+    if(m_trace) {
+        std::fprintf(m_trace, "i %s\n", name);
+    }
     Symbol* r = m_cur_scope->insert(name, s);
     if(r == NULL) {
         return true;
@@ -187,6 +280,9 @@ bool SymTab::insert_in_parent_scope(char* name, Symbol* s)
     assert(is_dup_string(name));
     // make sure there is an actual parent scope
     assert(m_cur_scope->m_parent != NULL);
+    if(m_trace) {
+        std::fprintf(m_trace, "p %s\n", name);
+    }
     Symbol* r = m_cur_scope->m_parent->insert(name, s);
     if(r == NULL) {
         return true;
@@ -198,14 +294,27 @@ bool SymTab::insert_in_parent_scope(char* name, Symbol* s)
 Symbol* SymTab::lookup(const char* name)
 {
     assert(name != NULL);
-    return m_cur_scope->lookup( name );
+    if(m_trace) {
+        std::fprintf(m_trace, "l %s\n", name);
+    }
+    return counted_lookup(m_cur_scope, name);
 }
 
 Symbol* SymTab::lookup(SymScope* targetscope, const char* name)
 {
     assert(name != NULL);
     assert(targetscope != NULL);
-    return targetscope->lookup(name);
+    return counted_lookup(targetscope, name);
+}
+
+Symbol* SymTab::counted_lookup(SymScope* scope, const char* name)
+{
+    Symbol* s = scope->lookup(name, &m_lookup_probes, m_horizon);
+    m_lookups++;
+    if(s == NULL) {
+        m_lookup_misses++;
+    }
+    return s;
 }
 
 int SymTab::scopesize(SymScope* targetscope)
@@ -217,10 +326,72 @@ int SymTab::lexical_distance(SymScope* higher_scope, SymScope* deeper_scope)
 {
     assert(deeper_scope != NULL);
     assert(higher_scope != NULL);
-    if(higher_scope == deeper_scope) {
-        return 0;
+    assert(higher_scope->encloses(deeper_scope));
+    return deeper_scope->m_depth - higher_scope->m_depth;
+}
+
+bool SymTab::encloses(SymScope* outer, SymScope* inner)
+{
+    assert(outer != NULL);
+    assert(inner != NULL);
+    return outer->encloses(inner);
+}
+
+int SymTab::depth(SymScope* targetscope)
+{
+    assert(targetscope != NULL);
+    return targetscope->m_depth;
+}
+
+int SymTab::scope_id(SymScope* targetscope)
+{
+    assert(targetscope != NULL);
+    return targetscope->m_id;
+}
+
+int SymTab::num_scopes()
+{
+    return m_next_scope_id;
+}
+
+void SymTab::resolve_access(const std::vector<SymRef>& refs,
+                            std::vector<SymAccess>& out)
+{
+    out.resize(refs.size());
+    for(size_t i = 0; i < refs.size(); i++) {
+        assert(refs[i].scope != NULL);
+        assert(refs[i].name != NULL);
+        Symbol* s = counted_lookup(refs[i].scope, refs[i].name);
+        out[i].symbol = s;
+        if(s == NULL) {
+            out[i].distance = -1;
+            out[i].offset = -1;
+        } else {
+            // lookup only ever finds symbols in enclosing scopes
+            out[i].distance = refs[i].scope->m_depth - s->m_symscope->m_depth;
+            out[i].offset = s->m_offset;
+        }
     }
-    return lexical_distance( higher_scope, deeper_scope->m_parent ) + 1;
+}
+
+void SymTab::freeze(SymScope* targetscope)
+{
+    assert(targetscope != NULL);
+    if(m_trace && targetscope == m_cur_scope) {
+        std::fprintf(m_trace, "f\n");
+    }
+    targetscope->freeze();
+}
+
+void SymTab::set_horizon(int order)
+{
+    m_horizon = order;
+}
+
+bool SymTab::is_frozen(SymScope* targetscope)
+{
+    assert(targetscope != NULL);
+    return targetscope->m_is_frozen;
 }
 
 void SymTab::dump(FILE* f)
@@ -228,34 +399,65 @@ void SymTab::dump(FILE* f)
     m_head->dump(f, 0);
 }
 
+void SymTab::stats(SymTabStats& out)
+{
+    memset(&out, 0, sizeof(out));
+    m_head->collect(out);
+    out.lookups = m_lookups;
+    out.lookup_probes = m_lookup_probes;
+    out.lookup_misses = m_lookup_misses;
+}
+
 /****** SymScope Implementation **************************************/
 
 SymScope::SymScope()
 {
-    m_parent = NULL;
-    m_scopesize = 0;
+    init(NULL);
 }
 
 SymScope::SymScope(SymScope * parent)
+{
+    init(parent);
+}
+
+void SymScope::init(SymScope* parent)
 {
     m_parent = parent;
+    m_depth = parent != NULL ? parent->m_depth + 1 : 0;
+    m_id = 0;
+    m_last_id = -1;
     m_scopesize = 0;
+    m_frozen.clear();
+    m_frozen_mask = 0;
+    m_is_frozen = false;
     if(parent!=NULL) {
         parent->add_child(this);
     }
 }
 
-SymScope::~SymScope()
+void SymScope::recycle(std::vector<SymScope*>& spare, std::set<Symbol*>& symbols)
 {
-    // Delete the keys, but not the symbols (symbols are linked elsewhere)
-    for(ScopeTableType::iterator si = m_scopetable.begin(), this_si;
-            si != m_scopetable.end();)
+    m_scopetable.for_each([&symbols](const char* name, Symbol* s) {
+        std::free((char*)name);
+        symbols.insert(s);
+    });
+    m_scopetable.clear();
+    for(std::list<SymScope*>::iterator li = m_child.begin();
+            li != m_child.end(); ++li)
     {
-        this_si = si;
-        ++si;
-
-        m_scopetable.erase(this_si);
+        (*li)->recycle(spare, symbols);
+        spare.push_back(*li);
     }
+    m_child.clear();
+    init(NULL);
+}
+
+SymScope::~SymScope()
+{
+    // Delete the keys, but not the symbols (symbols are linked elsewhere)
+    m_scopetable.for_each([](const char* name, Symbol*) {
+        std::free((char*)name);
+    });
 
     // Now delete all the children
     for(std::list<SymScope*>::iterator li = m_child.begin();
@@ -276,15 +478,13 @@ void SymScope::dump(FILE* f, int nest_level)
     }
     std::fprintf(f, "+-- Symbol Scope ---\n");
 
-    for(ScopeTableType::iterator si = m_scopetable.begin();
-            si != m_scopetable.end(); ++si)
-    {
+    m_scopetable.for_each([f, nest_level](const char* name, Symbol*) {
         // Indent appropriately
         for(int i=0; i<nest_level; i++) {
             std::fprintf(f, "\t");
         }
-        std::fprintf(f, "| %s \n", (char*) si->first.c_str());
-    }
+        std::fprintf(f, "| %s \n", name);
+    });
 
     for(int i=0; i<nest_level; i++) {
         std::fprintf(f, "\t");
@@ -299,11 +499,37 @@ void SymScope::dump(FILE* f, int nest_level)
     }
 }
 
+void SymScope::collect(SymTabStats& out)
+{
+    int n = (int)m_scopetable.size();
+    // A frozen scope is searched through its own table
+    size_t buckets = m_is_frozen ? m_frozen.size() : m_scopetable.buckets();
+
+    out.scopes++;
+    out.max_depth = std::max(out.max_depth, m_depth);
+    out.symbols += n;
+    out.max_symbols = std::max(out.max_symbols, n);
+    int c = 0;
+    while(c < SymTabStats::size_classes - 1 && (1 << c) <= n) {
+        c++;
+    }
+    out.by_size[c]++;
+    out.buckets += buckets;
+    if(buckets > 0) {
+        out.max_load = std::max(out.max_load, (double)n / buckets);
+    }
+
+    for(std::list<SymScope*>::iterator li = m_child.begin();
+            li != m_child.end(); ++li)
+    {
+        (*li)->collect(out);
+    }
+}
+
 bool SymScope::is_dup_string(char* name)
 {
-    ScopeTableType::iterator si = m_scopetable.find(name);
-    if(si != m_scopetable.end() && (char*)si->first.c_str() == name) {
-        // Check if the pointers match
+    if(m_scopetable.holds_key(name)) {
+        // The pointers match
         return false;
     }
 
@@ -320,14 +546,30 @@ bool SymScope::is_dup_string(char* name)
     return true;
 }
 
+bool SymScope::encloses(SymScope* inner)
+{
+    // Scopes are opened and closed like a stack, so every scope numbered
+    // after this one is nested in it until this one is closed
+    if(inner->m_id < m_id) {
+        return false;
+    }
+    return m_last_id < 0 || inner->m_id <= m_last_id;
+}
+
 void SymScope::add_child(SymScope* c)
 {
     m_child.push_back(c);
 }
 
-SymScope* SymScope::open_scope()
+SymScope* SymScope::open_scope(std::vector<SymScope*>& spare)
 {
-    return new SymScope(this);
+    if(spare.empty()) {
+        return new SymScope(this);
+    }
+    SymScope* s = spare.back();
+    spare.pop_back();
+    s->init(this);
+    return s;
 }
 
 SymScope* SymScope::close_scope()
@@ -335,7 +577,7 @@ SymScope* SymScope::close_scope()
     return m_parent;
 }
 
-bool SymScope::exist( char* name )
+bool SymScope::exist( const char* name )
 {
     Symbol* s;
     s = lookup(name);
@@ -347,12 +589,54 @@ bool SymScope::exist( char* name )
     }
 }
 
+void SymScope::freeze()
+{
+    // Size the table to a power of two at most half full so probe
+    // sequences stay short
+    unsigned int cap = 2;
+    while(cap < 2 * m_scopetable.size()) {
+        cap <<= 1;
+    }
+    FrozenSlot empty = { 0, NULL, NULL };
+    m_frozen.assign(cap, empty);
+    m_frozen_mask = cap - 1;
+
+    m_scopetable.for_each([this](const char* name, Symbol* s) {
+        unsigned int h = scopetable_hash(name);
+        unsigned int i = h & m_frozen_mask;
+        while(m_frozen[i].name != NULL) {
+            i = (i + 1) & m_frozen_mask;
+        }
+        m_frozen[i].hash = h;
+        m_frozen[i].name = name;
+        m_frozen[i].symbol = s;
+    });
+    m_is_frozen = true;
+}
+
+Symbol* SymScope::lookup_local( const char * name )
+{
+    if(m_is_frozen) {
+        unsigned int h = scopetable_hash(name);
+        unsigned int i = h & m_frozen_mask;
+        while(m_frozen[i].name != NULL) {
+            if(m_frozen[i].hash == h && !strcmp(m_frozen[i].name, name)) {
+                return m_frozen[i].symbol;
+            }
+            i = (i + 1) & m_frozen_mask;
+        }
+        return NULL;
+    }
+
+    return m_scopetable.find( name );
+}
+
 Symbol* SymScope::insert( char* name, Symbol * s )
 {
-    std::pair<ScopeTableType::iterator,bool> iret;
-    typedef std::pair<char*,Symbol*> hpair;
-    iret = m_scopetable.insert(hpair(name, s));
-    if(iret.second == true) {
+    // A frozen scope is read-only
+    assert(!m_is_frozen);
+    Symbol* conflict = m_scopetable.insert(name, s);
+    if(conflict == NULL) {
         // Insert was successfull
         s->m_offset = m_scopesize;
         m_scopesize += s->get_size();
@@ -362,24 +646,23 @@ Symbol* SymScope::insert( char* name, Symbol * s )
     } else {
         // Cannot insert, there was a duplicate entry
         // Return a pointer to the conflicting symbol
-        return iret.first->second;
+        return conflict;
     }
 }
 
-Symbol* SymScope::lookup( const char * name )
+Symbol* SymScope::lookup( const char * name, long* probes, int horizon )
 {
-    // First check the current table;
-    ScopeTableType::const_iterator i;
-    i = m_scopetable.find( (char*) name );
-    if(i != m_scopetable.end()) {
-        return i->second;
+    // Check the current table, then each of the parents in turn
+    for(SymScope* scope = this; scope != NULL; scope = scope->m_parent) {
+        if(probes) {
+            (*probes)++;
+        }
+        Symbol* s = scope->lookup_local( name );
+        if(s != NULL && s->m_order <= horizon) {
+            return s;
+        }
     }
 
-    // Failing that, check all the parents;
-    if( m_parent != NULL) {
-        return m_parent->lookup( name );
-    } else {
-        // If this has no parents, then it cannot be found
-        return NULL;
-    }
+    // If no scope has it, then it cannot be found
+    return NULL;
 }
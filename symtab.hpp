@@ -3,11 +3,10 @@
 
 #include <algorithm>
 #include <functional>
-#include <unordered_map>
 #include <vector>
-#include <ext/hash_map>
 
 #include <cassert>
+#include <cstdio>
 
 #include "ast.hpp"
 #include "attribute.hpp"
@@ -65,6 +64,10 @@ class Symbol
     std::vector<Basetype> m_arg_type;
     Basetype m_return_type;
 
+    // Position of a top level procedure in the program, 0 for the first;
+    // -1 for every other symbol.  See SymTab::set_horizon.
+    int m_order;
+
     //WRITEME: add string size information
 
     Symbol()
@@ -72,6 +75,7 @@ class Symbol
         m_offset = -1;
         m_symscope = NULL;
         m_basetype = bt_undef;
+        m_order = -1;
     }
 
     int get_size()
@@ -94,10 +98,14 @@ class Symbol
             return(4);
         case bt_intptr:
             return(4);
+        case bt_error:
+            // Stands in for an undefined name, never stored
+            return(0);
         case bt_undef:
             // Fall through
         default:
             assert(0);
+            return(0);  // Only reached with NDEBUG
 
         // WRITEME: add string size calc and assert size != 0
       }
@@ -124,6 +132,39 @@ class Symbol
     ~Symbol() { }
 };
 
+// A name as seen from a particular scope, for SymTab::resolve_access
+struct SymRef
+{
+    SymScope* scope;
+    const char* name;
+};
+
+// How to reach a resolved name at run time: follow distance static links
+// from the referencing scope, then index the frame at offset.  distance
+// and offset are -1 (and symbol NULL) if the name did not resolve.
+struct SymAccess
+{
+    int distance;
+    int offset;
+    Symbol* symbol;
+};
+
+// Shape of a symbol table and how it has been used, for --stats
+struct SymTabStats
+{
+    enum { size_classes = 8 };  // scopes holding 0, 1, 2-3, 4-7, ... symbols
+    int scopes;                 // the outermost one included
+    int max_depth;              // deepest nesting, 0 for the outermost scope
+    long symbols;
+    int max_symbols;            // in the fullest scope
+    int by_size[size_classes];  // last class also counts larger scopes
+    long buckets;               // hash buckets or slots over all scopes
+    double max_load;            // highest symbols per bucket of any scope
+    long lookups;               // lookup and exist calls
+    long lookup_probes;         // scopes searched by those calls
+    long lookup_misses;         // calls that found nothing
+};
+
 // This is the symbol table header which is similar to the interface described
 // in class. There is a open and close scope to grow a symbol table tree.
 // lookup and exist recurisively search all of the parent scopes, while insert
@@ -133,7 +174,15 @@ class SymTab
   private:
     SymScope* m_head;
     SymScope* m_cur_scope;
+    FILE* m_trace;
+    int m_next_scope_id;
+    long m_lookups;
+    long m_lookup_probes;
+    long m_lookup_misses;
+    int m_horizon;
+    std::vector<SymScope*> m_spare;     // Emptied by reset, for open_scope
     bool is_dup_string(char*);
+    Symbol* counted_lookup(SymScope* scope, const char* name);
 
   public:
     SymTab();
@@ -147,7 +196,7 @@ class SymTab
 
     // Returns true if name is found in the current SymTab or any of the
     // parents
-    bool exist(char* name);
+    bool exist(const char* name);
 
     // Tries to insert a pointer to s into the symbol table and returns true
     // if successful.
@@ -180,9 +229,57 @@ class SymTab
     // _nested_inside_ the higher_scope as assertion will fail
     int lexical_distance(SymScope* higher_scope, SymScope* deeper_scope);
 
+    // Returns true if inner is outer or is nested (at any depth) inside it
+    bool encloses(SymScope* outer, SymScope* inner);
+
+    // Returns the nesting depth of targetscope (0 for the outermost scope)
+    int depth(SymScope* targetscope);
+
+    // Returns the number of targetscope, which is unique within this SymTab:
+    // 0 for the outermost scope, then 1, 2, ... in the order they opened
+    int scope_id(SymScope* targetscope);
+
+    // Returns how many scopes have been opened so far, the outermost one
+    // included
+    int num_scopes();
+
+    // Looks up every (scope, name) pair in refs and stores the matching
+    // static-link distance and frame offset in the same position of out
+    void resolve_access(const std::vector<SymRef>& refs,
+                        std::vector<SymAccess>& out);
+
+    // Rebuilds targetscope into a compact, read-only open-addressed table.
+    // Use it once a scope is complete (e.g. the global procedure scope).
+    // Lookups in a frozen scope never write to it, so they can be shared
+    // across threads.  Inserting into a frozen scope is an assertion failure.
+    void freeze(SymScope* targetscope);
+    bool is_frozen(SymScope* targetscope);
+
+    // From now on lookups pass over any symbol whose m_order is above
+    // order, as if it had not been inserted yet, and go on to the parent
+    // scope.  A scope filled in ahead of time, and frozen, can then still
+    // be seen declaration by declaration.  INT_MAX (the default) sees all.
+    void set_horizon(int order);
+
+    // Empty the table for the next program: every scope but the outermost
+    // is closed, and every symbol and key is deleted (each symbol once,
+    // however many names it was bound to).  The scopes and their tables
+    // are kept and reused by open_scope, so a long running csimple --daemon
+    // does not allocate them again for each request.
+    void reset();
+
+    // Fill in out with the shape of every scope opened so far and the cost
+    // of the lookups made through this SymTab
+    void stats(SymTabStats& out);
+
     // Dump the contents of the symbol table to the file
-    // descriptor provided.  very useful for debugging
+    // descriptor provided.  very useful for debugging.  Tools that need to
+    // find definitions and uses should read --xref-out (see xref.hpp).
     void dump(FILE* f);
+
+    // Log every open, close, insert, lookup and freeze on the current scope
+    // to f, one per line, for replay by bench/symtab_replay.  NULL stops it.
+    void set_trace(FILE* f);
 };
 
 #endif //SYMTAB_HPP
@@ -0,0 +1,145 @@
+#!/bin/sh
+#
+# Checks csimple against the sample programs in tests/ (run with
+# "make check").
+#
+# For each tests/NAME.args, csimple is run on tests/NAME (on no input if
+# there is no such file) once per line of options there, and the
+# transcript
+#
+#   $ csimple OPTIONS
+#   stdout and stderr
+#   exit STATUS
+#
+# must match tests/NAME.expected.  "sh tests/run.sh update" rewrites the
+# expected transcripts instead; review them with git diff.
+#
+# Each transcript is then made again with the program parsed by
+# --push-bytes, in pieces of several sizes, and must not change: the
+# push_* samples put strings, comments and character literals where those
+# pieces split them.
+#
+# A NAME.args line may also run csimple --daemon, with tests/NAME a
+# series of requests (see daemon.hpp), as tests/daemon does.
+#
+# If there is a tests/NAME.next, each line is instead run three times
+# with one fresh --incremental state file: on tests/NAME, then twice on
+# tests/NAME.next, as tests/incremental does.  The --stats report, which
+# depends on the build, is left out of the transcript, but not its
+# "incremental:" line.
+#
+# A program that checks clean is also loaded back from the binary AST it
+# writes (--ast-out, --ast-in), which must give the same dot graph,
+# messages and cross-reference index (so the same lines and columns).
+#
+# Every program is also run twice against a fresh --cache-dir.  The second
+# run is served from the cache and must write the same stdout, stderr,
+# exit status and --dot-out file as the first; a run with errors must
+# leave an existing --dot-out file as it was.
+#
+
+CSIMPLE=${CSIMPLE:-./csimple}
+T=${TMPDIR:-/tmp}/csimple-tests.$$
+mkdir -p $T
+trap 'rm -rf $T' EXIT
+passed=0
+failed=0
+
+ok() {
+    passed=$((passed + 1))
+}
+
+fail() {
+    echo "FAIL: $*"
+    failed=$((failed + 1))
+}
+
+# The transcript of tests/$1.args, with $2 added to options that parse
+transcript() {
+    if [ -f tests/$1 ]; then in=tests/$1; else in=/dev/null; fi
+    while IFS= read -r opts; do
+        case "$opts" in
+            *--ast-in=*|*--stop-after=lex*|*--daemon*) more= ;;
+            *) more=$2 ;;
+        esac
+        if [ -f tests/$1.next ]; then
+            incremental "$opts" "$more" $in tests/$1.next
+            continue
+        fi
+        printf '$ csimple%s\n' "${opts:+ $opts}"
+        $CSIMPLE $opts $more < $in 2>&1
+        echo "exit $?"
+    done < tests/$1.args
+}
+
+# Options $1 (and $2) run on $3, then twice on $4, sharing an
+# --incremental state file
+incremental() {
+    rm -f $T/state
+    for f in $3 $4 $4; do
+        printf '$ csimple%s --incremental=STATE < %s\n' "${1:+ $1}" $f
+        $CSIMPLE $1 $2 --incremental=$T/state < $f > $T/run 2>&1
+        status=$?
+        sed '/^===== csimple stats =====$/,/^AST bytes allocated/d' $T/run
+        echo "exit $status"
+    done
+}
+
+# The round trip of tests/$1 through a binary AST, if it checks clean
+round_trip() {
+    $CSIMPLE --ast-out=$T/ast --xref-out=$T/xref.1 < tests/$1 \
+        > $T/dot.1 2> $T/err.1 || return 0
+    $CSIMPLE --ast-in=$T/ast --xref-out=$T/xref.2 < /dev/null \
+        > $T/dot.2 2> $T/err.2
+    if [ $? -eq 0 ] && cmp -s $T/dot.1 $T/dot.2 && cmp -s $T/err.1 $T/err.2 \
+            && cmp -s $T/xref.1 $T/xref.2; then
+        ok
+    else
+        fail "$1 --ast-out, --ast-in"
+    fi
+}
+
+# The miss and the hit of tests/$1 through a fresh cache
+cache_hit() {
+    rm -rf $T/cache
+    for i in 1 2; do
+        echo stale > $T/cdot.$i
+        $CSIMPLE --keep-going --cache-dir=$T/cache --dot-out=$T/cdot.$i \
+            < tests/$1 > $T/cout.$i 2> $T/cerr.$i
+        echo "exit $?" >> $T/cerr.$i
+    done
+    if ls $T/cache/*.entry > /dev/null 2>&1 && cmp -s $T/cout.1 $T/cout.2 \
+            && cmp -s $T/cerr.1 $T/cerr.2 && cmp -s $T/cdot.1 $T/cdot.2; then
+        ok
+    else
+        fail "$1 --cache-dir"
+    fi
+}
+
+for a in tests/*.args; do
+    name=$(basename $a .args)
+    transcript $name > $T/$name.out
+    if [ "$1" = update ]; then
+        cp $T/$name.out tests/$name.expected
+        continue
+    elif diff -u tests/$name.expected $T/$name.out; then
+        ok
+    else
+        fail $name
+    fi
+    for n in 1 2 3 5 8 13 64; do
+        transcript $name --push-bytes=$n > $T/$name.push
+        if diff -u tests/$name.expected $T/$name.push; then
+            ok
+        else
+            fail "$name --push-bytes=$n"
+        fi
+    done
+    if [ -f tests/$name ]; then
+        round_trip $name
+        cache_hit $name
+    fi
+done
+
+echo "$passed passed, $failed failed"
+[ $failed -eq 0 ]
@@ -1,22 +1,51 @@
-#include <iostream>
+#include <climits>
 #include <cstdio>
 #include <cstring>
 
 #include "ast.hpp"
 #include "symtab.hpp"
 #include "primitive.hpp"
+#include "ast2dot.hpp"
+#include "eventtrace.hpp"
+#include "visitprofile.hpp"
+#include "probes.hpp"
+#include "diagnostics.hpp"
+#include "incremental.hpp"
+#include "xref.hpp"
+#include "reachable.hpp"
+#include "sourcemap.hpp"
+#include "passmanager.hpp"
 #include "assert.h"
 
 // WRITEME: The default attribute propagation rule
-#define default_rule(X) (X->visit_children(this))
+#define default_rule(X) (this->visit_children(X))
 
 #include <typeinfo>
 
-class Typecheck : public Visitor
+// The virtual walk for BasicTypecheck, through accept and visit_children,
+// with the same calls as StaticVisitor's static one
+class VirtualWalk : public Visitor
+{
+  public:
+    template<class T> void visit(T* p) { p->accept(this); }
+    template<class T> void visit_children(T* p) { p->visit_children(this); }
+};
+
+// Walk is VirtualWalk for Typecheck, which VisitProfiled can wrap, or a
+// StaticVisitor for StaticTypecheck, which has no virtual calls
+template<class Walk>
+class BasicTypecheck : public Walk
 {
   private:
-    FILE* m_errorfile;
+    Diagnostics* m_diags;
     SymTab* m_st;
+    Incremental* m_incremental;     // NULL unless --incremental
+    Xref* m_xref;                   // NULL unless --xref-out
+    Reachable* m_reachable;         // NULL unless --reachable-only
+    ProcImpl* m_top;                // Top level procedure being checked
+    int m_order;                    // and its position, see register_procs
+    bool m_signature_typed;         // register_procs visited m_top's types
+    SymScope* m_global;
 
     // The set of recognized errors
     enum errortype
@@ -44,85 +73,163 @@ class Typecheck : public Visitor
         invalid_deref
     };
 
-    // Print the error to file and exit
-    void t_error(errortype e, Attribute a)
+    // Report the error, which exits unless we are keeping going.  Then the
+    // node that failed gets type bt_error so nothing built on it is
+    // reported again (visits set a node's type before checking it, so the
+    // mark sticks).
+    void t_error(errortype e, Attribute& a)
     {
-        fprintf(m_errorfile,"on line number %d, ", a.lineno);
+        CSIMPLE_PROBE2(error, (int)e, source_map.line(a.m_offset));
+        const char* msg;
+        int code;
 
         switch(e)
         {
             case no_main:
-                fprintf(m_errorfile, "error: no main\n");
-                exit(2);
+                msg = "no main";
+                code = 2;
+                break;
             case nonvoid_main:
-                fprintf(m_errorfile, "error: the Main procedure has arguments\n");
-                exit(3);
+                msg = "the Main procedure has arguments";
+                code = 3;
+                break;
             case dup_proc_name:
-                fprintf(m_errorfile, "error: duplicate procedure names in same scope\n");
-                exit(4);
+                msg = "duplicate procedure names in same scope";
+                code = 4;
+                break;
             case dup_var_name:
-                fprintf(m_errorfile, "error: duplicate variable names in same scope\n");
-                exit(5);
+                msg = "duplicate variable names in same scope";
+                code = 5;
+                break;
             case proc_undef:
-                fprintf(m_errorfile, "error: call to undefined procedure\n");
-                exit(6);
+                msg = "call to undefined procedure";
+                code = 6;
+                break;
             case var_undef:
-                fprintf(m_errorfile, "error: undefined variable\n");
-                exit(7);
+                msg = "undefined variable";
+                code = 7;
+                break;
             case narg_mismatch:
-                fprintf(m_errorfile, "error: procedure call has different number of args than declartion\n");
-                exit(8);
+                msg = "procedure call has different number of args than declartion";
+                code = 8;
+                break;
             case arg_type_mismatch:
-                fprintf(m_errorfile, "error: argument type mismatch\n");
-                exit(9);
+                msg = "argument type mismatch";
+                code = 9;
+                break;
             case ret_type_mismatch:
-                fprintf(m_errorfile, "error: type mismatch in return statement\n");
-                exit(10);
+                msg = "type mismatch in return statement";
+                code = 10;
+                break;
             case call_type_mismatch:
-                fprintf(m_errorfile, "error: type mismatch in procedure call args\n");
-                exit(11);
+                msg = "type mismatch in procedure call args";
+                code = 11;
+                break;
             case ifpred_err:
-                fprintf(m_errorfile, "error: predicate of if statement is not boolean\n");
-                exit(12);
+                msg = "predicate of if statement is not boolean";
+                code = 12;
+                break;
             case whilepred_err:
-                fprintf(m_errorfile, "error: predicate of while statement is not boolean\n");
-                exit(13);
+                msg = "predicate of while statement is not boolean";
+                code = 13;
+                break;
             case array_index_error:
-                fprintf(m_errorfile, "error: array index not integer\n");
-                exit(14);
+                msg = "array index not integer";
+                code = 14;
+                break;
             case no_array_var:
-                fprintf(m_errorfile, "error: attempt to index non-array variable\n");
-                exit(15);
+                msg = "attempt to index non-array variable";
+                code = 15;
+                break;
             case incompat_assign:
-                fprintf(m_errorfile, "error: type of expr and var do not match in assignment\n");
-                exit(16);
+                msg = "type of expr and var do not match in assignment";
+                code = 16;
+                break;
             case expr_type_err:
-                fprintf(m_errorfile, "error: incompatible types used in expression\n");
-                exit(17);
+                msg = "incompatible types used in expression";
+                code = 17;
+                break;
             case expr_abs_error:
-                fprintf(m_errorfile, "error: absolute value can only be applied to integers and strings\n");
-                exit(17);
+                msg = "absolute value can only be applied to integers and strings";
+                code = 17;
+                break;
             case expr_pointer_arithmetic_err:
-                fprintf(m_errorfile, "error: invalid pointer arithmetic\n");
-                exit(18);
+                msg = "invalid pointer arithmetic";
+                code = 18;
+                break;
             case expr_addressof_error:
-                fprintf(m_errorfile, "error: AddressOf can only be applied to integers, chars, and indexed strings\n");
-                exit(19);
+                msg = "AddressOf can only be applied to integers, chars, and indexed strings";
+                code = 19;
+                break;
             case invalid_deref:
-                fprintf(m_errorfile, "error: Deref can only be applied to integer pointers and char pointers\n");
-                exit(20);
+                msg = "Deref can only be applied to integer pointers and char pointers";
+                code = 20;
+                break;
             default:
-                fprintf(m_errorfile, "error: no good reason\n");
-                exit(21);
+                msg = "no good reason";
+                code = 21;
+                break;
         }
+        m_diags->report(code, a.m_offset, msg);
+        a.m_basetype = bt_error;
     }
 
     // Helpers
 
+    // True if a or b is bt_error: something under p has been reported
+    // already, so p is marked bt_error instead of being checked again
+    bool poisoned(Attribute& p, Basetype a, Basetype b = bt_undef)
+    {
+        if(a == bt_error || b == bt_error) {
+            p.m_basetype = bt_error;
+            return true;
+        }
+        return false;
+    }
+
+    // Tell --incremental that the procedure being checked used the global
+    // procedure s
+    void note_use(Symbol* s, const char* name)
+    {
+        if(m_incremental && m_top && s && s->m_basetype == bt_procedure
+                && s->get_scope() == m_global) {
+            m_incremental->used(m_top, name);
+        }
+    }
+
+    // Tell --xref-out that a node of kind refers to name, which has been
+    // checked (so it is at least declared as undefined)
+    void note_ref(const char* name, Attribute& a, AstKind kind)
+    {
+        if(m_xref) {
+            m_xref->use(m_st->lookup(name), m_st->scope_id(m_st->get_scope()),
+                        source_map.line(a.m_offset), kind);
+        }
+    }
+
+    // Tell --xref-out that s has been entered into the symbol table as name
+    void note_def(Symbol* s, const char* name, Attribute& a, AstKind kind)
+    {
+        if(m_xref) {
+            SymScope* scope = s->get_scope();
+            m_xref->define(s, name, m_st->scope_id(scope), m_st->depth(scope),
+                           source_map.line(a.m_offset), kind);
+        }
+    }
+
+    // After name has been reported undefined, declare it in the current
+    // scope with type bt_error so its other uses are not reported too
+    void declare_undefined(const char* name)
+    {
+        Symbol* s = new Symbol();
+        s->m_basetype = bt_error;
+        m_st->insert(strdup(name), s);
+    }
+
     const char * lhs_to_id (Lhs* lhs){
         Variable *v = dynamic_cast<Variable*>(lhs);
         if(v) {
-                return strdup(v->m_symname->spelling());
+                return v->m_symname->spelling();
         }
 
         DerefVariable *dv = dynamic_cast<DerefVariable*>(lhs);
@@ -144,8 +251,9 @@ class Typecheck : public Visitor
     void check_for_one_main(ProgramImpl* p)
     {
         //Check if a main exists
-        if(!m_st->exist(strdup("Main"))){
+        if(!m_st->exist("Main")){
             this->t_error(no_main, p->m_attribute);
+            return;
         }
         
         //Lookup the Symbol for Main and the Current Scope(Global Scope)
@@ -154,6 +262,7 @@ class Typecheck : public Visitor
 
         if(main->get_scope() != global_scope){
             this->t_error(no_main, p->m_attribute);
+            return;
         }
 
         //Make sure main has no arguments
@@ -163,16 +272,14 @@ class Typecheck : public Visitor
 
     }
 
-    // Create a symbol for the procedure and check there is none already
-    // existing
-    void add_proc_symbol(ProcImpl* p)
+    // Create a symbol for the procedure from its signature, whose type
+    // nodes have been visited
+    Symbol* proc_symbol(ProcImpl* p)
     {
-        char* name;
         Symbol* s;
         
         //Initialize Base Symbol Attributes
         s = new Symbol();
-        name = strdup(p->m_symname->spelling());
         s->m_basetype = bt_procedure;
 
         //Initialize Procedure Attributes
@@ -187,17 +294,93 @@ class Typecheck : public Visitor
              //Push number of types per variable declared
              if(current)
              for(int i=0; i<(*current).m_symname_list->size(); i++){
-                s->m_arg_type.push_back((*iter)->m_attribute.m_basetype);
+                s->m_arg_type.push_back(current->m_type->m_attribute.m_basetype);
              }
         }
+        return s;
+    }
+
+    // The procedure's name is taken in its scope
+    void dup_proc_error(ProcImpl* p)
+    {
+        if(strcmp(p->m_symname->spelling(), "Main")==0){
+            this->t_error(no_main, p->m_attribute);
+        } else {
+            this->t_error(dup_proc_name, p->m_attribute);
+        }
+    }
+
+    // Create a symbol for the (nested) procedure and check there is none
+    // already existing
+    void add_proc_symbol(ProcImpl* p)
+    {
+        char* name = strdup(p->m_symname->spelling());
+        Symbol* s = proc_symbol(p);
         if(!m_st->insert_in_parent_scope(name, s)){
-                if(strcmp(name, "Main")==0){
-                    this->t_error(no_main, p->m_attribute);
-                } 
-                //Check if symbol is not already present
-                this->t_error(dup_proc_name, p->m_attribute);
+                dup_proc_error(p);
+                // Not kept by the symbol table
+                free(name);
+                delete s;
+        } else {
+            note_def(s, name, p->m_attribute, ast_kind_ProcImpl);
+        }
+
+    }
+
+    // Enter every top level procedure into the global scope, numbered in
+    // program order, and freeze it so each call is looked up in the frozen
+    // table.  Their parameter and return types are visited here, once;
+    // visitProcImpl reuses them.  The lookup horizon hides each procedure
+    // until enter_proc_symbol reaches it, so a call to one defined further
+    // down is still undefined.
+    void register_procs(ProgramImpl* p)
+    {
+        int order = 0;
+        for(std::list<Proc_ptr>::iterator iter = p->m_proc_list->begin();
+            iter != p->m_proc_list->end(); ++iter, ++order)
+        {
+            ProcImpl* proc = dynamic_cast<ProcImpl*>(*iter);
+            assert(proc != NULL);
+            for(std::list<Decl_ptr>::iterator d = proc->m_decl_list->begin();
+                d != proc->m_decl_list->end(); ++d)
+            {
+                DeclImpl* decl = dynamic_cast<DeclImpl*>(*d);
+                if(decl) {
+                    this->visit(decl->m_type);
+                }
+            }
+            this->visit(proc->m_type);
+
+            Symbol* s = proc_symbol(proc);
+            char* name = strdup(proc->m_symname->spelling());
+            s->m_order = order;
+            if(m_st->insert(name, s)) {
+                proc->m_symname->set_symbol(s);
+            } else {
+                // Reported when the procedure is reached
+                free(name);
+                delete s;
+            }
         }
+        m_st->freeze(m_global);
+        m_order = -1;
+        m_st->set_horizon(m_order);
+    }
 
+    // add_proc_symbol for the next top level procedure, registered by
+    // register_procs: it and those before it can be seen from now on
+    void enter_proc_symbol(ProcImpl* p)
+    {
+        m_st->set_horizon(++m_order);
+        Symbol* s = p->m_symname->symbol();
+        if(s == NULL) {
+            // An earlier procedure has the name
+            dup_proc_error(p);
+            return;
+        }
+        assert(s->m_order == m_order);
+        note_def(s, p->m_symname->spelling(), p->m_attribute,
+                 ast_kind_ProcImpl);
     }
 
     // Add symbol table information for all the declarations following
@@ -214,7 +397,11 @@ class Typecheck : public Visitor
 
             if(!m_st->insert(name, s)){ //Check if symbol is not already present
                 this->t_error(dup_var_name, p->m_attribute);
-            }    
+                free(name);
+                delete s;
+            } else {
+                note_def(s, name, p->m_attribute, ast_kind_DeclImpl);
+            }
             
         }
     }
@@ -224,7 +411,7 @@ class Typecheck : public Visitor
     {
         Basetype neededRet = p->m_type->m_attribute.m_basetype;
         Basetype actualRet = p->m_procedure_block->m_attribute.m_basetype;
-        if(neededRet != actualRet){
+        if(neededRet != actualRet && actualRet != bt_error){
             this->t_error(ret_type_mismatch, p->m_attribute);
         }
     }
@@ -241,28 +428,36 @@ class Typecheck : public Visitor
     // and return values are consistent
     void check_call(Call *p)
     {
-        char* pName = strdup(p->m_symname->spelling());
+        const char* pName = p->m_symname->spelling();
         //Check if the procedure is defined
         if(!this->m_st->exist(pName)){
             this->t_error(proc_undef, p->m_attribute);
+            declare_undefined(pName);
         }
         //Check if the lhs is defined
-        else if(!this->m_st->exist(strdup(lhs_to_id(p->m_lhs)))){
+        else if(!this->m_st->exist(lhs_to_id(p->m_lhs))){
             this->t_error(var_undef, p->m_attribute);
         }
         else{
             //Lookup the symbol to reference
             Symbol * s = this->m_st->lookup(pName);
 
+            //Already reported as undefined
+            if(s->m_basetype == bt_error){
+                return;
+            }
+
             //Make sure the type of the symbol is a procedure
             if(s->m_basetype != bt_procedure){
                 this->t_error(proc_undef, p->m_attribute);
+                return;
             }
        
              
             //Make sure number of arguments provided matches symbol
             if(s->m_arg_type.size() != p->m_expr_list->size()){
                 this->t_error(narg_mismatch, p->m_attribute);
+                return;
             }
 
             //Run through each type and make sure they are the same
@@ -272,17 +467,18 @@ class Typecheck : public Visitor
             iter != p->m_expr_list->end(); ++iter)
             {
                 //Compare BaseTypes of basetype to Expression
-                if((*iter)->m_attribute.m_basetype != (*sym)){
+                Basetype arg = (*iter)->m_attribute.m_basetype;
+                if(arg != (*sym) && arg != bt_error && (*sym) != bt_error){
                     this->t_error(arg_type_mismatch, p->m_attribute);
+                    break;
                 }
                 //Advance Symbol Arguments
                 sym++;
             }
             
             //Make sure return type matches LHS type
-            std::cout << "LHS: " << p->m_lhs->m_attribute.m_basetype<<std::endl;
-            std::cout << "RetType: " << s->m_return_type<<std::endl;
-            if(s->m_return_type != p->m_lhs->m_attribute.m_basetype){
+            Basetype lhs = p->m_lhs->m_attribute.m_basetype;
+            if(s->m_return_type != lhs && lhs != bt_error){
                 t_error(call_type_mismatch, p->m_attribute);
             }
             
@@ -292,7 +488,8 @@ class Typecheck : public Visitor
     // For checking that this expressions type is boolean used in if/else
     void check_pred_if(Expr* p)
     {
-        if(p->m_attribute.m_basetype != bt_boolean){
+        Basetype bt = p->m_attribute.m_basetype;
+        if(bt != bt_boolean && bt != bt_error){
             this->t_error(ifpred_err, p->m_attribute);
         }
     }
@@ -300,7 +497,8 @@ class Typecheck : public Visitor
     // For checking that this expressions type is boolean used in while
     void check_pred_while(Expr* p)
     {
-        if(p->m_attribute.m_basetype != bt_boolean){
+        Basetype bt = p->m_attribute.m_basetype;
+        if(bt != bt_boolean && bt != bt_error){
             this->t_error(whilepred_err, p->m_attribute);
         }
     }
@@ -308,6 +506,10 @@ class Typecheck : public Visitor
 
     void check_assignment(Assignment* p)
     {
+        if(poisoned(p->m_attribute, p->m_lhs->m_attribute.m_basetype,
+                    p->m_expr->m_attribute.m_basetype)){
+            return;
+        }
         if(p->m_lhs->m_attribute.m_basetype != p->m_expr->m_attribute.m_basetype){
             this->t_error(incompat_assign, p->m_attribute);
         }
@@ -317,23 +519,30 @@ class Typecheck : public Visitor
 
     void check_string_assignment(StringAssignment* p)
     {
-        if(p->m_lhs->m_attribute.m_basetype != bt_string){
+        Basetype bt = p->m_lhs->m_attribute.m_basetype;
+        if(bt != bt_string && bt != bt_error){
             this->t_error(incompat_assign, p->m_attribute);
         }
     }
 
     void check_array_access(ArrayAccess* p)
     {
-        char * name = strdup((p->m_symname->spelling()));
+        const char* name = p->m_symname->spelling();
         if(!m_st->exist(name)){
             //Make sure this is the proper error code
             t_error(no_array_var,p->m_attribute);
+            declare_undefined(name);
+            return;
         }
         Symbol* s = m_st->lookup(name);
+        if(poisoned(p->m_attribute, s->m_basetype)){
+            return;
+        }
+        Basetype index = p->m_expr->m_attribute.m_basetype;
         if(s->m_basetype != bt_string){
             t_error(no_array_var, p->m_attribute);
         }
-        else if(p->m_expr->m_attribute.m_basetype != bt_integer){
+        else if(index != bt_integer && index != bt_error){
             t_error(array_index_error, p->m_attribute);
         }
         
@@ -341,16 +550,22 @@ class Typecheck : public Visitor
 
     void check_array_element(ArrayElement* p)
     {
-        char * name = strdup((p->m_symname->spelling()));
+        const char* name = p->m_symname->spelling();
         if(!m_st->exist(name)){
             //Make sure this is the proper error code
             t_error(no_array_var,p->m_attribute);
+            declare_undefined(name);
+            return;
         }
         Symbol* s = m_st->lookup(name);
+        if(poisoned(p->m_attribute, s->m_basetype)){
+            return;
+        }
+        Basetype index = p->m_expr->m_attribute.m_basetype;
         if(s->m_basetype != bt_string){
             t_error(no_array_var, p->m_attribute);
         }
-        else if(p->m_expr->m_attribute.m_basetype != bt_integer){
+        else if(index != bt_integer && index != bt_error){
             t_error(array_index_error, p->m_attribute);
         }
 
@@ -360,6 +575,10 @@ class Typecheck : public Visitor
     // For checking boolean operations(and, or ...)
     void checkset_boolexpr(Expr* parent, Expr* child1, Expr* child2)
     {
+        if(poisoned(parent->m_attribute, child1->m_attribute.m_basetype,
+                    child2->m_attribute.m_basetype)){
+            return;
+        }
         if(child1->m_attribute.m_basetype != bt_boolean ||
             child1->m_attribute.m_basetype != bt_boolean){
             t_error(expr_type_err, parent->m_attribute);
@@ -371,6 +590,9 @@ class Typecheck : public Visitor
     {
         Basetype c1 = child1->m_attribute.m_basetype;
         Basetype c2 = child2->m_attribute.m_basetype;
+        if(poisoned(parent->m_attribute, c1, c2)){
+            return;
+        }
         //If Either Expressions are not integers, return an error
         if(c1 != bt_integer || c2 != bt_integer){
             if(c1 == bt_ptr || c1 == bt_intptr || c1 == bt_charptr ||
@@ -390,6 +612,9 @@ class Typecheck : public Visitor
     {
         Basetype c1 = child1->m_attribute.m_basetype;
         Basetype c2 = child2->m_attribute.m_basetype;
+        if(poisoned(parent->m_attribute, c1, c2)){
+            return;
+        }
         //If One is a charptr and one is an integer, return (accept)
         if(c1 == bt_integer && c2 == bt_integer){
             return;
@@ -405,6 +630,10 @@ class Typecheck : public Visitor
     // For checking relational(less than , greater than, ...)
     void checkset_relationalexpr(Expr* parent, Expr* child1, Expr* child2)
     {
+        if(poisoned(parent->m_attribute, child1->m_attribute.m_basetype,
+                    child2->m_attribute.m_basetype)){
+            return;
+        }
         if(child1->m_attribute.m_basetype != bt_integer ||
            child2->m_attribute.m_basetype != bt_integer)
         {
@@ -417,8 +646,12 @@ class Typecheck : public Visitor
     {
         Basetype c1 = child1->m_attribute.m_basetype;
         Basetype c2 = child2->m_attribute.m_basetype;
+        if(poisoned(parent->m_attribute, c1, c2)){
+            return;
+        }
         if(c1 == bt_string || c2 == bt_string){
             this->t_error(expr_type_err, parent->m_attribute);
+            return;
         }
         
         //If the types are not the same, must determine if pointers present
@@ -440,6 +673,9 @@ class Typecheck : public Visitor
     // For checking not
     void checkset_not(Expr* parent, Expr* child)
     {
+        if(poisoned(parent->m_attribute, child->m_attribute.m_basetype)){
+            return;
+        }
         //Not must be boolean expression
         if(child->m_attribute.m_basetype != bt_boolean){
             this->t_error(expr_type_err, parent->m_attribute);
@@ -449,6 +685,9 @@ class Typecheck : public Visitor
     // For checking unary minus
     void checkset_uminus(Expr* parent, Expr* child)
     {
+        if(poisoned(parent->m_attribute, child->m_attribute.m_basetype)){
+            return;
+        }
         if(child->m_attribute.m_basetype != bt_integer){
             this->t_error(expr_type_err, parent->m_attribute);
         }
@@ -458,6 +697,9 @@ class Typecheck : public Visitor
     void checkset_absolute_value(Expr* parent, Expr* child)
     {
         Basetype bt = child->m_attribute.m_basetype;
+        if(poisoned(parent->m_attribute, bt)){
+            return;
+        }
         if(bt != bt_integer && bt != bt_string){
             this->t_error(expr_type_err, parent->m_attribute);
         }
@@ -467,6 +709,9 @@ class Typecheck : public Visitor
     void checkset_addressof(Expr* parent, Lhs* child)
     {
         Basetype bt = child->m_attribute.m_basetype;
+        if(poisoned(parent->m_attribute, bt)){
+            return;
+        }
         if(bt != bt_integer && bt != bt_char){
             this->t_error(expr_addressof_error, parent->m_attribute);
         }
@@ -475,6 +720,9 @@ class Typecheck : public Visitor
     void checkset_deref_expr(Deref* parent,Expr* child)
     {
         Basetype bt = child->m_attribute.m_basetype;
+        if(poisoned(parent->m_attribute, bt)){
+            return;
+        }
         if(bt != bt_intptr && bt != bt_charptr){
             this->t_error(invalid_deref, parent->m_attribute);
         }
@@ -486,12 +734,17 @@ class Typecheck : public Visitor
     void checkset_deref_lhs(DerefVariable* p)
     {
        //Check if lhs exists
-       if(!m_st->exist(strdup(p->m_symname->spelling()))){
+       if(!m_st->exist(p->m_symname->spelling())){
             this->t_error(var_undef, p->m_attribute);
+            declare_undefined(p->m_symname->spelling());
+            return;
         } 
 
-        Symbol* sym = m_st->lookup(strdup(p->m_symname->spelling()));
+        Symbol* sym = m_st->lookup(p->m_symname->spelling());
         Basetype bt = sym->m_basetype;
+        if(poisoned(p->m_attribute, bt)){
+            return;
+        }
         if(bt != bt_intptr && bt != bt_charptr){
             this->t_error(invalid_deref, p->m_attribute);
         }
@@ -499,56 +752,130 @@ class Typecheck : public Visitor
 
     void checkset_variable(Variable* p)
     {
-        if(!m_st->exist(strdup(p->m_symname->spelling())))
+        if(!m_st->exist(p->m_symname->spelling())) {
             this->t_error(var_undef, p->m_attribute);
+            declare_undefined(p->m_symname->spelling());
+        }
     }
 
     void checkset_ident(Ident* p)
     {
-        if(!m_st->exist(strdup(p->m_symname->spelling())))
+        if(!m_st->exist(p->m_symname->spelling())) {
             this->t_error(var_undef, p->m_attribute);
+            declare_undefined(p->m_symname->spelling());
+        }
     }
 
 
   public:
 
-    Typecheck(FILE* errorfile, SymTab* st) {
-        m_errorfile = errorfile;
+    BasicTypecheck(Diagnostics* diags, SymTab* st,
+                   Incremental* incremental = NULL, Xref* xref = NULL,
+                   Reachable* reachable = NULL) {
+        m_diags = diags;
         m_st = st;
+        m_incremental = incremental;
+        m_xref = xref;
+        m_reachable = reachable;
+        m_top = NULL;
+        m_order = -1;
+        m_signature_typed = false;
+        m_global = NULL;
+    }
+
+    // visitProgramImpl, before and after its procedures, for TypecheckPass
+    // which hands them over one at a time
+    void begin_program(ProgramImpl* p)
+    {
+       m_global = m_st->get_scope();
+       register_procs(p);
+    }
+
+    void end_program(ProgramImpl* p)
+    {
+       m_st->set_horizon(INT_MAX);
+       check_for_one_main(p);
     }
 
     void visitProgramImpl(ProgramImpl* p)
     {
+       begin_program(p);
        default_rule(p);       
-       check_for_one_main(p);
+       end_program(p);
     }
 
     void visitProcImpl(ProcImpl* p)
     {
+        // For the --trace-events span of this procedure
+        double start = event_trace ? event_trace->now() : 0;
+        int scopes = m_st->num_scopes();
+        ProcImpl* outer = m_top;
+        if(outer == NULL) {
+            m_top = p;
+        }
+        int errors = m_diags->count();
+
         //Open New Scope
         this->m_st->open_scope();    
+        const char* name = p->m_symname->spelling();
+        int depth = m_st->depth(m_st->get_scope());
+        CSIMPLE_PROBE2(proc__start, name, depth);
     
         //Visit Arguments to define types for the symbol
+       m_signature_typed = outer == NULL;
        for(std::list<Decl_ptr>::iterator iter = p->m_decl_list->begin(); 
         iter != p->m_decl_list->end(); ++iter)
         {
-            (*iter)->accept(this);
+            this->visit(*iter);
         }
+       m_signature_typed = false;
 
 
-       p->m_type->accept(this);
+       if(outer != NULL) {
+           this->visit(p->m_type);
+       }
 
                
        //Add the new procedure symbols to the symtab
-       add_proc_symbol(p); 
+       if(outer == NULL) {
+           enter_proc_symbol(p);
+       } else {
+           add_proc_symbol(p);
+       }
+
+       // Only the signature is needed of a procedure Main cannot reach,
+       // or one that checked cleanly last time and uses nothing that has
+       // changed since.  The index needs the uses in every procedure.
+       if(outer == NULL && !m_xref
+               && ((m_reachable && m_reachable->skip(p))
+                   || (m_incremental && m_incremental->skip(p)))) {
+           m_st->close_scope();
+           m_top = NULL;
+           return;
+       }
 
        //Call accept on all children besides the arguments 
-       p->m_symname->accept(this);
-       p->m_procedure_block->accept(this);
+       this->visit(p->m_symname);
+       this->visit(p->m_procedure_block);
 
        //Make sure the procedure properly defined 
        check_proc(p); 
 
+       if(event_trace) {
+           event_trace->span("typecheck", name, start,
+                             count_ast_nodes(p), m_st->num_scopes() - scopes);
+       }
+       if(CSIMPLE_PROBE_ENABLED(proc__done)) {
+           CSIMPLE_PROBE4(proc__done, name, depth, count_ast_nodes(p),
+                          m_st->num_scopes() - scopes);
+       }
+       if(outer == NULL) {
+           if(m_incremental) {
+               m_incremental->done(p, m_diags->count() == errors);
+           }
+           m_top = NULL;
+       }
+
     }
 
     void visitCall(Call* p)
@@ -557,7 +884,13 @@ class Typecheck : public Visitor
        check_call(p);   
     
        Symbol* sym = m_st->lookup(p->m_symname->spelling());
-       p->m_attribute.m_basetype = sym->m_return_type;
+       note_use(sym, p->m_symname->spelling());
+       note_ref(p->m_symname->spelling(), p->m_attribute, ast_kind_Call);
+       if(sym->m_basetype == bt_procedure) {
+           p->m_attribute.m_basetype = sym->m_return_type;
+       } else {
+           p->m_attribute.m_basetype = bt_error;    // reported by check_call
+       }
        
        //Symbol* sym = this->m_st->lookup(strdup(p->m_symname->spelling())); 
        //p->m_attribute.m_basetype = sym->m_return_type;
@@ -579,7 +912,16 @@ class Typecheck : public Visitor
 
     void visitDeclImpl(DeclImpl* p)
     {
-       default_rule(p);
+       if(m_signature_typed) {
+           // A parameter of a top level procedure, typed by register_procs
+           for(std::list<SymName_ptr>::iterator iter = p->m_symname_list->begin();
+               iter != p->m_symname_list->end(); ++iter)
+           {
+               this->visit(*iter);
+           }
+       } else {
+           default_rule(p);
+       }
        p->m_attribute.m_basetype = p->m_type->m_attribute.m_basetype;
        add_decl_symbol(p); 
                
@@ -608,7 +950,9 @@ class Typecheck : public Visitor
        checkset_ident(p);
     
        //If it does look it up and set the type
-       Symbol* var = this->m_st->lookup(strdup(p->m_symname->spelling()));     
+       Symbol* var = this->m_st->lookup(p->m_symname->spelling());     
+       note_use(var, p->m_symname->spelling());
+       note_ref(p->m_symname->spelling(), p->m_attribute, ast_kind_Ident);
        p->m_attribute.m_basetype =  var->m_basetype; 
     }
 
@@ -683,57 +1027,56 @@ class Typecheck : public Visitor
     void visitAnd(And* p)
     {
        default_rule(p);
-       checkset_boolexpr(p, p->m_expr_1, p->m_expr_2);      
        p->m_attribute.m_basetype = bt_boolean; 
+       checkset_boolexpr(p, p->m_expr_1, p->m_expr_2);      
     }
 
     void visitDiv(Div* p)
     {
        default_rule(p);
-       checkset_arithexpr(p, p->m_expr_1, p->m_expr_2);
        p->m_attribute.m_basetype = bt_integer; 
+       checkset_arithexpr(p, p->m_expr_1, p->m_expr_2);
     }
 
     void visitCompare(Compare* p)
     {
        default_rule(p);
-       checkset_equalityexpr(p,p->m_expr_1,p->m_expr_2);
        p->m_attribute.m_basetype = bt_boolean;      
+       checkset_equalityexpr(p,p->m_expr_1,p->m_expr_2);
  
     }
 
     void visitGt(Gt* p)
     {
        default_rule(p);       
-       checkset_relationalexpr(p, p->m_expr_1, p->m_expr_2);
        p->m_attribute.m_basetype = bt_boolean; 
+       checkset_relationalexpr(p, p->m_expr_1, p->m_expr_2);
     }
 
     void visitGteq(Gteq* p)
     {
        default_rule(p);       
-       checkset_relationalexpr(p, p->m_expr_1, p->m_expr_2);
        p->m_attribute.m_basetype = bt_boolean; 
+       checkset_relationalexpr(p, p->m_expr_1, p->m_expr_2);
     }
 
     void visitLt(Lt* p)
     {
        default_rule(p);       
-       checkset_relationalexpr(p, p->m_expr_1, p->m_expr_2);
        p->m_attribute.m_basetype = bt_boolean; 
+       checkset_relationalexpr(p, p->m_expr_1, p->m_expr_2);
     }
 
     void visitLteq(Lteq* p)
     {
        default_rule(p);       
-       checkset_relationalexpr(p, p->m_expr_1, p->m_expr_2);
        p->m_attribute.m_basetype = bt_boolean; 
+       checkset_relationalexpr(p, p->m_expr_1, p->m_expr_2);
     }
 
     void visitMinus(Minus* p)
     {
        default_rule(p);       
-       checkset_arithexpr_or_pointer(p, p->m_expr_1, p->m_expr_2);
        //Save basetype pointers
        Basetype c1 = p->m_expr_1->m_attribute.m_basetype;
        Basetype c2 = p->m_expr_2->m_attribute.m_basetype;
@@ -748,26 +1091,26 @@ class Typecheck : public Visitor
         else{
             p->m_attribute.m_basetype = bt_integer;
         }
+       checkset_arithexpr_or_pointer(p, p->m_expr_1, p->m_expr_2);
     }
 
     void visitNoteq(Noteq* p)
     {
        default_rule(p);       
-       checkset_equalityexpr(p, p->m_expr_1, p->m_expr_2);
        p->m_attribute.m_basetype = bt_boolean;
+       checkset_equalityexpr(p, p->m_expr_1, p->m_expr_2);
     }
 
     void visitOr(Or* p)
     {
        default_rule(p);
-       checkset_boolexpr(p, p->m_expr_1, p->m_expr_2);     
        p->m_attribute.m_basetype = bt_boolean;
+       checkset_boolexpr(p, p->m_expr_1, p->m_expr_2);     
     }
 
     void visitPlus(Plus* p)
     {
        default_rule(p);       
-       checkset_arithexpr_or_pointer(p, p->m_expr_1, p->m_expr_2);
         //Save basetype pointers
        Basetype c1 = p->m_expr_1->m_attribute.m_basetype;
        Basetype c2 = p->m_expr_2->m_attribute.m_basetype;
@@ -782,35 +1125,37 @@ class Typecheck : public Visitor
         else{
             p->m_attribute.m_basetype = bt_integer;
         }
+       checkset_arithexpr_or_pointer(p, p->m_expr_1, p->m_expr_2);
 
     }
 
     void visitTimes(Times* p)
     {
        default_rule(p);       
-       checkset_arithexpr(p, p->m_expr_1, p->m_expr_2);
        p->m_attribute.m_basetype = bt_integer;
+       checkset_arithexpr(p, p->m_expr_1, p->m_expr_2);
     }
 
     void visitNot(Not* p)
     {
        default_rule(p);       
-       checkset_not(p, p->m_expr);       
        p->m_attribute.m_basetype = bt_boolean;
+       checkset_not(p, p->m_expr);       
     }
 
     void visitUminus(Uminus* p)
     {
        default_rule(p);       
-       checkset_uminus(p, p->m_expr);       
        p->m_attribute.m_basetype = bt_integer;
+       checkset_uminus(p, p->m_expr);       
     }
 
     void visitArrayAccess(ArrayAccess* p)
     {
        default_rule(p);
-       check_array_access(p);
        p->m_attribute.m_basetype = bt_char;
+       check_array_access(p);
+       note_ref(p->m_symname->spelling(), p->m_attribute, ast_kind_ArrayAccess);
     }
 
     void visitIntLit(IntLit* p)
@@ -840,8 +1185,8 @@ class Typecheck : public Visitor
     void visitAbsoluteValue(AbsoluteValue* p)
     {
        default_rule(p);       
-       checkset_absolute_value(p, p->m_expr);       
        p->m_attribute.m_basetype = bt_integer;
+       checkset_absolute_value(p, p->m_expr);       
     }
 
     void visitAddressOf(AddressOf* p)
@@ -866,7 +1211,9 @@ class Typecheck : public Visitor
     {
        default_rule(p);   
        checkset_variable(p);
-       Symbol* var = this->m_st->lookup(strdup(p->m_symname->spelling()));     
+       Symbol* var = this->m_st->lookup(p->m_symname->spelling());     
+       note_use(var, p->m_symname->spelling());
+       note_ref(p->m_symname->spelling(), p->m_attribute, ast_kind_Variable);
        p->m_attribute.m_basetype =  var->m_basetype; 
     }
 
@@ -889,9 +1236,10 @@ class Typecheck : public Visitor
     {
        default_rule(p);       
        checkset_deref_lhs(p);       
+       note_ref(p->m_symname->spelling(), p->m_attribute, ast_kind_DerefVariable);
        
         //Lookup type of the symbol being dereferenced
-        Symbol* s = this->m_st->lookup(strdup(p->m_symname->spelling()));
+        Symbol* s = this->m_st->lookup(p->m_symname->spelling());
         Basetype bt = s->m_basetype;
     
         if(bt == bt_intptr){
@@ -906,8 +1254,9 @@ class Typecheck : public Visitor
     void visitArrayElement(ArrayElement* p)
     {
        default_rule(p);
-       check_array_element(p);
        p->m_attribute.m_basetype = bt_char;
+       check_array_element(p);
+       note_ref(p->m_symname->spelling(), p->m_attribute, ast_kind_ArrayElement);
     }
 
     // Special cases
@@ -916,10 +1265,76 @@ class Typecheck : public Visitor
     void visitStringPrimitive(StringPrimitive* p) {}
 };
 
+typedef BasicTypecheck<VirtualWalk> Typecheck;
+
+class StaticTypecheck : public BasicTypecheck<StaticVisitor<StaticTypecheck> >
+{
+  public:
+    using BasicTypecheck<StaticVisitor<StaticTypecheck> >::BasicTypecheck;
+};
+
+
+// Typecheck as one of the passes of a PassManager
+class TypecheckPass : public FusedPass
+{
+  private:
+    StaticTypecheck m_typecheck;
+
+  public:
+    TypecheckPass(Diagnostics* diags, SymTab* st, Incremental* incremental,
+                  Xref* xref, Reachable* reachable)
+        : m_typecheck(diags, st, incremental, xref, reachable) {}
+
+    int order() { return pre_order | post_order; }
+
+    void program(ProgramImpl* p, Order when)
+    {
+        if(when == pre_order) {
+            m_typecheck.begin_program(p);
+        } else {
+            m_typecheck.end_program(p);
+        }
+    }
+
+    void proc(ProcImpl* p) { m_typecheck.visit(p); }
+};
+
+// Plan the skipping that incremental and reachable do
+static void plan(Program_ptr ast, Incremental* incremental,
+                 Reachable* reachable)
+{
+    if(incremental || reachable) {
+        ProgramImpl* prog = dynamic_cast<ProgramImpl*>(ast);
+        assert(prog != NULL);
+        if(incremental) {
+            incremental->plan(prog);
+        }
+        if(reachable) {
+            reachable->plan(prog);
+        }
+    }
+}
+
+void dopass_typecheck(Program_ptr ast, SymTab* st, Diagnostics* diags,
+                      VisitProfile* profile, Incremental* incremental,
+                      Xref* xref, Reachable* reachable)
+{
+    plan(ast, incremental, reachable);
+    if(profile) {
+        // Profiling wraps the virtual visits
+        VisitProfiled<Typecheck> typecheck(profile, diags, st, incremental,
+                                           xref, reachable);
+        ast->accept(&typecheck);
+    } else {
+        StaticTypecheck typecheck(diags, st, incremental, xref, reachable);
+        typecheck.visit(ast);   // Walk the tree with the visitor above
+    }
+}
 
-void dopass_typecheck(Program_ptr ast, SymTab* st)
+FusedPass* fused_typecheck(Program_ptr ast, SymTab* st, Diagnostics* diags,
+                           Incremental* incremental, Xref* xref,
+                           Reachable* reachable)
 {
-    Typecheck* typecheck = new Typecheck(stderr, st);
-    ast->accept(typecheck); // Walk the tree with the visitor above
-    delete typecheck;
+    plan(ast, incremental, reachable);
+    return new TypecheckPass(diags, st, incremental, xref, reachable);
 }
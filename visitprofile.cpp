@@ -0,0 +1,53 @@
+#include <algorithm>
+
+#include "visitprofile.hpp"
+
+VisitProfile::VisitProfile()
+{
+    Kind empty = {};
+    m_kinds.assign(ast_num_visit_kinds, empty);
+}
+
+void VisitProfile::print(FILE* f, const char* pass)
+{
+    std::vector<int> order;
+    unsigned long long total = 0;
+    for(int i = 0; i < ast_num_visit_kinds; i++) {
+        if(m_kinds[i].calls != 0) {
+            order.push_back(i);
+            total += m_kinds[i].self_ns;
+        }
+    }
+    if(order.empty()) {
+        return;             // The pass never ran
+    }
+    std::sort(order.begin(), order.end(), [this](int a, int b) {
+        return m_kinds[a].self_ns > m_kinds[b].self_ns;
+    });
+
+    fprintf(f, "===== visit profile: %s =====\n", pass);
+    fprintf(f, "%-22s %10s %10s %6s %9s %9s %9s\n", "visit", "calls",
+            "self(ms)", "%", "avg(ns)", "p50(ns)", "p99(ns)");
+    for(size_t i = 0; i < order.size(); i++) {
+        Kind& k = m_kinds[order[i]];
+
+        // Percentiles are the upper edge of the bucket they fall in
+        unsigned long seen = 0;
+        unsigned long long p50 = 0, p99 = 0;
+        for(int b = 0; b < buckets; b++) {
+            seen += k.hist[b];
+            if(p50 == 0 && seen * 2 >= k.calls) {
+                p50 = 1ull << b;
+            }
+            if(p99 == 0 && seen * 100 >= k.calls * 99) {
+                p99 = 1ull << b;
+            }
+        }
+
+        fprintf(f, "%-22s %10lu %10.3f %6.2f %9.0f %9llu %9llu\n",
+                ast_visit_names[order[i]], k.calls, k.self_ns * 1e-6,
+                total ? 100.0 * k.self_ns / total : 0.0,
+                (double)k.self_ns / k.calls, p50, p99);
+    }
+    fprintf(f, "%-22s %10s %10.3f\n", "total", "", total * 1e-6);
+}
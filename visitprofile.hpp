@@ -0,0 +1,75 @@
+#ifndef VISITPROFILE_HPP
+#define VISITPROFILE_HPP
+
+#include <cstdio>
+#include <ctime>
+#include <vector>
+
+#include "ast.hpp"
+
+// Visit counts and self time (time in a visit method minus the visits it
+// makes to children) for each node class, filled in by VisitProfiled<Pass>
+// from ast.hpp.  Times go into log2 nanosecond buckets so recording stays
+// cheap and a rough distribution is still available.
+class VisitProfile
+{
+  public:
+    enum { buckets = 40 };      // bucket b holds times in [2^(b-1), 2^b) ns
+
+  private:
+    struct Kind
+    {
+        unsigned long calls;
+        unsigned long long self_ns;
+        unsigned long hist[buckets];
+    };
+    struct Frame
+    {
+        unsigned long long start;
+        unsigned long long child_ns;    // Spent in nested visits
+    };
+    std::vector<Kind> m_kinds;
+    std::vector<Frame> m_stack;
+
+    static unsigned long long now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+
+    static int bucket(unsigned long long ns)
+    {
+        int b = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+        return b < buckets ? b : buckets - 1;
+    }
+
+  public:
+    VisitProfile();
+
+    void enter(int kind)
+    {
+        Frame f = { now(), 0 };
+        m_stack.push_back(f);
+    }
+
+    void leave(int kind)
+    {
+        Frame f = m_stack.back();
+        m_stack.pop_back();
+        unsigned long long total = now() - f.start;
+        unsigned long long self = total - f.child_ns;
+        Kind& k = m_kinds[kind];
+        k.calls++;
+        k.self_ns += self;
+        k.hist[bucket(self)]++;
+        if(!m_stack.empty()) {
+            m_stack.back().child_ns += total;
+        }
+    }
+
+    // Print one line per node class, most self time first
+    void print(FILE* f, const char* pass);
+};
+
+#endif //VISITPROFILE_HPP
@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "symtab.hpp"
+#include "xref.hpp"
+
+static const char xref_magic[8] = { 'C', 'S', 'X', 'R', 'E', 'F', 0, 1 };
+static const unsigned long xref_header = 24;
+static const unsigned long xref_symbol_size = 7 * 4;
+static const unsigned long xref_ref_size = 4 * 4;
+
+void Xref::define(Symbol* s, const char* name, int scope, int depth, int line,
+                  AstKind kind)
+{
+    Def d;
+    d.name = name;
+    d.scope = scope;
+    d.depth = depth;
+    d.line = line;
+    d.basetype = s->m_basetype;
+    m_index[s] = m_defs.size();
+    m_defs.push_back(d);
+    use(s, scope, line, kind);
+}
+
+void Xref::use(Symbol* s, int scope, int line, AstKind kind)
+{
+    std::map<Symbol*, int>::iterator i = m_index.find(s);
+    if(i == m_index.end()) {
+        return;
+    }
+    Ref r;
+    r.line = line;
+    r.symbol = i->second;
+    r.scope = scope;
+    r.kind = kind;
+    m_refs.push_back(r);
+}
+
+static void put_u32(std::string& buf, unsigned long v)
+{
+    for(int i = 0; i < 4; i++) {
+        buf.push_back((char)(v >> (8 * i)));
+    }
+}
+
+bool Xref::write(const char* path)
+{
+    // Symbols by name, then line
+    std::vector<int> order(m_defs.size());
+    for(size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](int a, int b) {
+        const Def& x = m_defs[a];
+        const Def& y = m_defs[b];
+        int c = x.name.compare(y.name);
+        return c != 0 ? c < 0 : x.line != y.line ? x.line < y.line
+                                                 : x.scope < y.scope;
+    });
+    std::vector<int> number(m_defs.size());
+    for(size_t i = 0; i < order.size(); i++) {
+        number[order[i]] = i;
+    }
+
+    // Refs by line, then symbol; a symbol's own refs stay in line order
+    std::vector<Ref> refs(m_refs);
+    for(size_t i = 0; i < refs.size(); i++) {
+        refs[i].symbol = number[refs[i].symbol];
+    }
+    std::stable_sort(refs.begin(), refs.end(), [](const Ref& a, const Ref& b) {
+        return a.line != b.line ? a.line < b.line : a.symbol < b.symbol;
+    });
+    std::vector<std::vector<unsigned long> > uses(m_defs.size());
+    for(size_t i = 0; i < refs.size(); i++) {
+        uses[refs[i].symbol].push_back(i);
+    }
+
+    unsigned long symbols = xref_header;
+    unsigned long strings = symbols + xref_symbol_size * m_defs.size()
+                          + xref_ref_size * refs.size() + 4 * refs.size();
+    std::string names;
+    std::map<std::string, unsigned long> interned;
+
+    std::string buf(xref_magic, sizeof(xref_magic));
+    put_u32(buf, m_defs.size());
+    put_u32(buf, refs.size());
+    put_u32(buf, strings);
+    put_u32(buf, 0);        // The size, once known
+    unsigned long first = 0;
+    for(size_t i = 0; i < order.size(); i++) {
+        const Def& d = m_defs[order[i]];
+        std::map<std::string, unsigned long>::iterator n = interned.find(d.name);
+        if(n == interned.end()) {
+            n = interned.insert(std::make_pair(d.name, strings + names.size())).first;
+            names.append(d.name.c_str(), d.name.size() + 1);
+        }
+        put_u32(buf, n->second);
+        put_u32(buf, d.scope);
+        put_u32(buf, d.depth);
+        put_u32(buf, d.line);
+        put_u32(buf, d.basetype);
+        put_u32(buf, first);
+        put_u32(buf, uses[i].size());
+        first += uses[i].size();
+    }
+    for(size_t i = 0; i < refs.size(); i++) {
+        put_u32(buf, refs[i].line);
+        put_u32(buf, refs[i].symbol);
+        put_u32(buf, refs[i].scope);
+        put_u32(buf, refs[i].kind);
+    }
+    for(size_t i = 0; i < uses.size(); i++) {
+        for(size_t j = 0; j < uses[i].size(); j++) {
+            put_u32(buf, uses[i][j]);
+        }
+    }
+    assert(buf.size() == strings);
+    buf += names;
+    std::string size;
+    put_u32(size, buf.size());
+    buf.replace(20, 4, size);
+
+    FILE* f = fopen(path, "wb");
+    if(f == NULL || fwrite(buf.data(), 1, buf.size(), f) != buf.size()
+            || fclose(f) != 0) {
+        perror(path);
+        return false;
+    }
+    return true;
+}
+
+XrefFile::XrefFile(const char* path)
+{
+    m_path = path;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        exit(1);
+    }
+    m_size = st.st_size;
+    void* data = m_size >= xref_header
+        ? mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if(data == MAP_FAILED || memcmp(data, xref_magic, sizeof(xref_magic)) != 0) {
+        fprintf(stderr, "%s: not a cross-reference index\n", path);
+        exit(1);
+    }
+    m_data = (const unsigned char*)data;
+    m_nsymbols = u32(8);
+    m_nrefs = u32(12);
+    m_strings = u32(16);
+
+    // Every table must fit before the strings, and every number in them
+    // point inside the file
+    bool ok = u32(20) == m_size && m_strings <= m_size
+        && m_nsymbols <= m_size / xref_symbol_size
+        && m_nrefs <= m_size / xref_ref_size
+        && xref_header + xref_symbol_size * m_nsymbols
+           + (xref_ref_size + 4) * m_nrefs == m_strings;
+    unsigned long nuses = 0;
+    for(unsigned long i = 0; ok && i < m_nsymbols; i++) {
+        const unsigned char* s = symbol(i);
+        unsigned long at = u32(s - m_data);
+        ok = at >= m_strings && at < m_size
+            && memchr(m_data + at, 0, m_size - at) != NULL
+            && u32(s + 20 - m_data) == nuses
+            && u32(s + 24 - m_data) <= m_nrefs - nuses;
+        nuses += ok ? u32(s + 24 - m_data) : 0;
+    }
+    ok = ok && nuses == m_nrefs;
+    for(unsigned long i = 0; ok && i < m_nrefs; i++) {
+        const unsigned char* r = ref(i);
+        ok = u32(r + 4 - m_data) < m_nsymbols
+            && u32(r + 12 - m_data) < (unsigned long)ast_num_visit_kinds
+            && u32(m_strings - 4 * m_nrefs + 4 * i) < m_nrefs;
+    }
+    if(!ok) {
+        fprintf(stderr, "%s: corrupt cross-reference index\n", path);
+        exit(1);
+    }
+}
+
+XrefFile::~XrefFile()
+{
+    munmap((void*)m_data, m_size);
+}
+
+unsigned long XrefFile::u32(unsigned long pos) const
+{
+    const unsigned char* p = m_data + pos;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+const unsigned char* XrefFile::symbol(unsigned long i) const
+{
+    return m_data + xref_header + xref_symbol_size * i;
+}
+
+const unsigned char* XrefFile::ref(unsigned long i) const
+{
+    return m_data + xref_header + xref_symbol_size * m_nsymbols
+         + xref_ref_size * i;
+}
+
+const char* XrefFile::name(const unsigned char* sym) const
+{
+    return (const char*)m_data + u32(sym - m_data);
+}
+
+XrefFile::Ref XrefFile::make_ref(unsigned long i) const
+{
+    const unsigned char* r = ref(i);
+    const unsigned char* s = symbol(u32(r + 4 - m_data));
+    AstKind kind = (AstKind)u32(r + 12 - m_data);
+    Ref out;
+    out.line = u32(r - m_data);
+    out.name = name(s);
+    out.scope = u32(r + 8 - m_data);
+    out.def_line = u32(s + 12 - m_data);
+    out.kind = ast_visit_names[kind];
+    out.is_def = kind == ast_kind_ProcImpl || kind == ast_kind_DeclImpl;
+    return out;
+}
+
+void XrefFile::uses(const char* n, std::vector<Ref>& out) const
+{
+    // The first symbol not before n
+    unsigned long lo = 0, hi = m_nsymbols;
+    while(lo < hi) {
+        unsigned long mid = lo + (hi - lo) / 2;
+        if(strcmp(name(symbol(mid)), n) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    unsigned long uses = m_strings - 4 * m_nrefs;
+    for(; lo < m_nsymbols && !strcmp(name(symbol(lo)), n); lo++) {
+        const unsigned char* s = symbol(lo);
+        unsigned long first = u32(s + 20 - m_data);
+        unsigned long count = u32(s + 24 - m_data);
+        for(unsigned long i = first; i < first + count; i++) {
+            out.push_back(make_ref(u32(uses + 4 * i)));
+        }
+    }
+}
+
+void XrefFile::at(int line, std::vector<Ref>& out) const
+{
+    unsigned long lo = 0, hi = m_nrefs;
+    while(lo < hi) {
+        unsigned long mid = lo + (hi - lo) / 2;
+        if((int)u32(ref(mid) - m_data) < line) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for(; lo < m_nrefs && (int)u32(ref(lo) - m_data) == line; lo++) {
+        out.push_back(make_ref(lo));
+    }
+}
+
+void XrefFile::print(FILE* f, const std::vector<Ref>& refs)
+{
+    for(size_t i = 0; i < refs.size(); i++) {
+        const Ref& r = refs[i];
+        fprintf(f, "%d %s %s %d %d %s\n", r.line, r.is_def ? "def" : "use",
+                r.name, r.scope, r.def_line, r.kind);
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef XREF_HPP
+#define XREF_HPP
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ast.hpp"
+#include "attribute.hpp"
+
+class Symbol;
+
+// Cross-reference index for --xref-out=FILE: every definition of a
+// procedure or variable and every use of one that typecheck resolved, with
+// its scope and line, so tools can answer "where is X used" and "what is
+// at line N" without running the checker again.
+//
+// The file is little endian, like a binary AST (see astbin.hpp):
+//
+//     "CSXREF" 0 <version>         8 bytes
+//     u32 nsymbols, u32 nrefs      table sizes
+//     u32 strings, u32 size        the names and the whole file
+//     symbols                      sorted by name, then line
+//     refs                         sorted by line, then symbol
+//     uses                         ref numbers, grouped by symbol
+//     strings                      NUL terminated, each name stored once
+//
+// so both questions are a binary search.  A symbol is 7 u32s: name (file
+// offset), scope, depth, line, basetype, and the first of its entries in
+// uses and how many there are.  A ref is 4 u32s: line, symbol, the scope
+// it was made from and the AstKind of its node (ProcImpl or DeclImpl for
+// a definition).
+class Xref
+{
+  private:
+    struct Def
+    {
+        std::string name;
+        int scope;
+        int depth;
+        int line;
+        Basetype basetype;
+    };
+    struct Ref
+    {
+        int line;
+        int symbol;             // Into m_defs
+        int scope;
+        AstKind kind;
+    };
+    std::vector<Def> m_defs;
+    std::vector<Ref> m_refs;
+    std::map<Symbol*, int> m_index;
+
+  public:
+    // s was entered as name into the scope numbered scope (SymTab::scope_id)
+    void define(Symbol* s, const char* name, int scope, int depth, int line,
+                AstKind kind);
+
+    // A node of kind at line, in scope, refers to s.  Symbols that were
+    // never defined (undefined names) are left out.
+    void use(Symbol* s, int scope, int line, AstKind kind);
+
+    // Sort the index and write it to path; false (and a message) on failure
+    bool write(const char* path);
+};
+
+// An index written by Xref, mapped into memory for queries.  Exits with a
+// message if the file is not a valid index.
+class XrefFile
+{
+  public:
+    struct Ref
+    {
+        int line;
+        const char* name;
+        int scope;
+        int def_line;
+        const char* kind;       // Node kind name, as ast_visit_names
+        bool is_def;
+    };
+
+  private:
+    std::string m_path;
+    const unsigned char* m_data;
+    unsigned long m_size;
+    unsigned long m_nsymbols;
+    unsigned long m_nrefs;
+    unsigned long m_strings;
+
+    unsigned long u32(unsigned long pos) const;
+    const unsigned char* symbol(unsigned long i) const;
+    const unsigned char* ref(unsigned long i) const;
+    const char* name(const unsigned char* sym) const;
+    Ref make_ref(unsigned long i) const;
+
+  public:
+    XrefFile(const char* path);
+    ~XrefFile();
+
+    // Every definition and use of each symbol spelled name, by line
+    void uses(const char* name, std::vector<Ref>& out) const;
+
+    // Every definition and use on line
+    void at(int line, std::vector<Ref>& out) const;
+
+    // One ref per line of f, as "line def|use name scope def_line kind"
+    static void print(FILE* f, const std::vector<Ref>& refs);
+};
+
+#endif //XREF_HPP